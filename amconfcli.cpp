@@ -0,0 +1,221 @@
+#include "batchgenerator.hpp"
+#include "outputfile.hpp"
+#include "schemawatcher.hpp"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThreadPool>
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+enum ExitCode {
+    Success,
+    UsageError,
+    LoadError,
+    VerifyError,
+    PrepareError,
+    WriteError
+};
+
+ExitCode exitCode(BatchGenerator::Status status)
+{
+    switch (status) {
+        case BatchGenerator::Success: return Success;
+        case BatchGenerator::LoadError: return LoadError;
+        case BatchGenerator::VerifyError: return VerifyError;
+        case BatchGenerator::PrepareError: return PrepareError;
+        case BatchGenerator::WriteError: return WriteError;
+    }
+    return WriteError;
+}
+
+int fail(ExitCode code, QString const &message)
+{
+    QTextStream err{stderr};
+    err << QCoreApplication::applicationName() << ": " << message << "\n";
+    return code;
+}
+
+QString milliseconds(qint64 nsecs)
+{
+    return QString::number(nsecs / 1e6, 'f', 1) + " ms";
+}
+
+void report(QTextStream &out, BatchGenerator::Result const &r)
+{
+    if (r.status == BatchGenerator::Success)
+        out << (r.unchanged ? "SAME  " : "OK    ") << r.filePath << " -> " << r.outputPath
+            << " (" << milliseconds(r.elapsed) << ")" << (r.message.isEmpty() ? "" : ", ") << r.message << "\n";
+    else
+        out << "FAIL  " << r.filePath << ": " << r.message << " (" << milliseconds(r.elapsed) << ")\n";
+    out.flush();
+}
+
+int generateOne(QString const &filePath, CodeGenerator::Firmware firmware, int optimizations, int minSuffixLength,
+                QString const &outputPath, bool verifyOnly)
+{
+    QByteArray output;
+    auto const result = (verifyOnly ? BatchGenerator::verify(filePath, firmware, optimizations, minSuffixLength)
+                                    : BatchGenerator::generate(filePath, firmware, output, optimizations, minSuffixLength));
+    if (result.status == BatchGenerator::LoadError)
+        return fail(LoadError, QString{"Failed to load %1: %2"}.arg(filePath, result.message));
+    if (result.status != BatchGenerator::Success)
+        return fail(exitCode(result.status), result.message);
+    if (!result.message.isEmpty())
+        QTextStream{stderr} << result.message << "\n";
+    if (verifyOnly)
+        return Success;
+
+    if (!outputPath.isEmpty() && outputPath != "-") {
+        QString error;
+        if (OutputFile::write(outputPath, output, &error) == OutputFile::Failed)
+            return fail(WriteError, QString{"Failed to write output: %1"}.arg(error));
+        return Success;
+    }
+
+    QFile file;
+    if (!file.open(stdout, QFile::WriteOnly))
+        return fail(WriteError, QString{"Failed to open output: %1"}.arg(file.errorString()));
+    if (file.write(output) != output.size() || !file.flush())
+        return fail(WriteError, QString{"Failed to write output: %1"}.arg(file.errorString()));
+
+    return Success;
+}
+
+int generateBatch(QStringList const &filePaths, CodeGenerator::Firmware firmware, int optimizations,
+                  int minSuffixLength, QString const &outputDir, int jobs)
+{
+    if (!QDir{}.mkpath(outputDir))
+        return fail(WriteError, QString{"Failed to create %1"}.arg(outputDir));
+
+    QElapsedTimer timer;
+    timer.start();
+    BatchGenerator batch{firmware, outputDir};
+    batch.setOptimizations(optimizations);
+    batch.setMinSuffixLength(minSuffixLength);
+    auto const results = batch.run(filePaths, jobs);
+    auto const wall = timer.nsecsElapsed();
+
+    QTextStream err{stderr};
+    qint64 total{0};
+    int failed{0};
+    ExitCode code{Success};
+    for (auto const &r: results) {
+        total += r.elapsed;
+        report(err, r);
+        if (r.status != BatchGenerator::Success) {
+            ++failed;
+            code = std::max(code, exitCode(r.status));
+        }
+    }
+
+    err << results.size() << " files, " << failed << " failed in " << milliseconds(wall)
+        << " (" << milliseconds(total) << " total, "
+        << QString::number(wall ? double(total) / wall : 0, 'f', 1) << "x parallel)\n";
+    return code;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("amconf-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates firmware sources from antecedent-morph schemas.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("schemas", "Schema files (.amconf or .amconfb) or directories containing them.",
+                                 "schemas...");
+    QCommandLineOption outputOption{{"o", "output"}, "Write to <file> instead of stdout.", "file"};
+    QCommandLineOption outputDirOption{{"d", "output-dir"},
+                                       "Generate every schema into <dir>, one file per schema.", "dir"};
+    QCommandLineOption jobsOption{{"j", "jobs"}, "Number of schemas to generate in parallel.", "n",
+                                  QString::number(QThreadPool::globalInstance()->maxThreadCount())};
+    QCommandLineOption firmwareOption{{"f", "firmware"}, "Target firmware, only zmk is supported.", "firmware", "zmk"};
+    QCommandLineOption verifyOption{"verify-only", "Verify and prepare the schema without generating."};
+    QCommandLineOption noOptimizeOption{"no-optimize", "Write every ZMK behavior, full mod-morph chains and one macro per cell."};
+    QCommandLineOption suffixOption{"factor-suffixes",
+                                    "Move macro endings of at least <keys> keys shared by several macros into "
+                                    "macros of their own, saving flash at the cost of one more behavior "
+                                    "invocation per keypress.", "keys"};
+    QCommandLineOption watchOption{{"w", "watch"}, "Keep running and regenerate schemas into --output-dir when they are saved."};
+    parser.addOption(outputOption);
+    parser.addOption(outputDirOption);
+    parser.addOption(jobsOption);
+    parser.addOption(firmwareOption);
+    parser.addOption(verifyOption);
+    parser.addOption(noOptimizeOption);
+    parser.addOption(suffixOption);
+    parser.addOption(watchOption);
+    parser.process(a);
+
+    auto const firmwareName = parser.value(firmwareOption).toLower();
+    if (firmwareName == "qmk")
+        return fail(UsageError, "QMK output is not supported yet");
+    if (firmwareName != "zmk")
+        return fail(UsageError, QString{"Unknown firmware '%1'"}.arg(firmwareName));
+    auto const firmware = CodeGenerator::ZMKFirmware;
+    auto optimizations = (parser.isSet(noOptimizeOption) ? int(ZmkCodeGenerator::NoOptimization)
+                                                         : ZmkCodeGenerator::DefaultOptimizations);
+    auto minSuffixLength = int(ZmkCodeGenerator::DefaultMinSuffixLength);
+    if (parser.isSet(suffixOption)) {
+        bool ok;
+        minSuffixLength = parser.value(suffixOption).toInt(&ok);
+        if (!ok || minSuffixLength < 1)
+            return fail(UsageError, QString{"Invalid suffix length '%1'"}.arg(parser.value(suffixOption)));
+        optimizations |= ZmkCodeGenerator::FactorSuffixes;
+    }
+
+    auto const args = parser.positionalArguments();
+    if (args.isEmpty())
+        return fail(UsageError, "No schema given, see --help");
+
+    if (parser.isSet(watchOption) && !parser.isSet(outputDirOption))
+        return fail(UsageError, "--watch needs --output-dir");
+
+    if (!parser.isSet(outputDirOption)) {
+        if (args.size() != 1 || QFileInfo{args.first()}.isDir())
+            return fail(UsageError, "Several schemas need --output-dir");
+        return generateOne(args.first(), firmware, optimizations, minSuffixLength,
+                           parser.value(outputOption), parser.isSet(verifyOption));
+    }
+
+    if (parser.isSet(outputOption) || parser.isSet(verifyOption))
+        return fail(UsageError, "--output-dir cannot be combined with --output or --verify-only");
+
+    bool ok;
+    auto const jobs = parser.value(jobsOption).toInt(&ok);
+    if (!ok || jobs < 1)
+        return fail(UsageError, QString{"Invalid job count '%1'"}.arg(parser.value(jobsOption)));
+
+    auto const filePaths = BatchGenerator::collect(args);
+    if (filePaths.isEmpty())
+        return fail(UsageError, "No schema files found");
+    auto const collision = BatchGenerator{firmware, parser.value(outputDirOption)}.findCollision(filePaths);
+    if (!collision.isEmpty())
+        return fail(UsageError, collision);
+
+    if (parser.isSet(watchOption)) {
+        if (!QDir{}.mkpath(parser.value(outputDirOption)))
+            return fail(WriteError, QString{"Failed to create %1"}.arg(parser.value(outputDirOption)));
+
+        QTextStream err{stderr};
+        SchemaWatcher watcher{firmware, parser.value(outputDirOption)};
+        watcher.setOptimizations(optimizations);
+        watcher.setMinSuffixLength(minSuffixLength);
+        QObject::connect(&watcher, &SchemaWatcher::regenerated, &a,
+                         [&err](BatchGenerator::Result const &r) { report(err, r); });
+        watcher.watch(filePaths);
+        return a.exec();
+    }
+
+    return generateBatch(filePaths, firmware, optimizations, minSuffixLength, parser.value(outputDirOption), jobs);
+}
@@ -0,0 +1,218 @@
+#include "batchgenerator.hpp"
+#include "outputfile.hpp"
+#include "schema.hpp"
+#include "schemafile.hpp"
+#include "qmkcodegenerator.hpp"
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QTextStream>
+#include <QThreadPool>
+
+BatchGenerator::BatchGenerator(CodeGenerator::Firmware firmware, const QString &outputDir)
+    : m_firmware{firmware},
+      m_outputDir{outputDir},
+      m_optimizations{ZmkCodeGenerator::DefaultOptimizations},
+      m_minSuffixLength{ZmkCodeGenerator::DefaultMinSuffixLength}
+{
+
+}
+
+void BatchGenerator::setOptimizations(int optimizations)
+{
+    m_optimizations = optimizations;
+}
+
+int BatchGenerator::optimizations() const
+{
+    return m_optimizations;
+}
+
+void BatchGenerator::setMinSuffixLength(int keys)
+{
+    m_minSuffixLength = keys;
+}
+
+int BatchGenerator::minSuffixLength() const
+{
+    return m_minSuffixLength;
+}
+
+QStringList BatchGenerator::collect(const QStringList &paths)
+{
+    // A file named twice, directly or through its directory, is generated once
+    QSet<QString> seen;
+    QStringList filePaths;
+    auto const add = [&](QString const &filePath) {
+        auto const canonical = QFileInfo{filePath}.canonicalFilePath();
+        if (!seen.contains(canonical.isEmpty() ? filePath : canonical)) {
+            seen.insert(canonical.isEmpty() ? filePath : canonical);
+            filePaths << filePath;
+        }
+    };
+
+    for (auto const &path: paths) {
+        if (!QFileInfo{path}.isDir()) {
+            add(path);
+            continue;
+        }
+
+        QStringList found;
+        QDirIterator it{path, {"*.amconf", QString{"*."} + SchemaFile::BinarySuffix}, QDir::Files};
+        while (it.hasNext())
+            found << it.next();
+        found.sort();
+        for (auto const &filePath: found)
+            add(filePath);
+    }
+    return filePaths;
+}
+
+QString BatchGenerator::findCollision(const QStringList &filePaths) const
+{
+    QHash<QString, QString> sources;
+    for (auto const &filePath: filePaths) {
+        auto const outputPath = outputPathFor(filePath);
+        auto const other = sources.constFind(outputPath);
+        if (other != sources.cend())
+            return QString{"%1 and %2 would both be written to %3"}.arg(*other, filePath, outputPath);
+        sources.insert(outputPath, filePath);
+    }
+    return {};
+}
+
+std::unique_ptr<CodeGenerator> BatchGenerator::createGenerator(Schema *schema, CodeGenerator::Firmware firmware,
+                                                               int optimizations, int minSuffixLength)
+{
+    if (firmware == CodeGenerator::QMKFirmware)
+        return std::make_unique<QmkCodeGenerator>(schema);
+
+    auto generator = std::make_unique<ZmkCodeGenerator>(schema);
+    generator->setOptimizations(optimizations);
+    generator->setMinSuffixLength(minSuffixLength);
+    return generator;
+}
+
+BatchGenerator::Result BatchGenerator::generate(const QString &filePath, CodeGenerator::Firmware firmware,
+                                                QByteArray &output, int optimizations, int minSuffixLength)
+{
+    return process(filePath, firmware, &output, optimizations, minSuffixLength);
+}
+
+BatchGenerator::Result BatchGenerator::verify(const QString &filePath, CodeGenerator::Firmware firmware,
+                                              int optimizations, int minSuffixLength)
+{
+    return process(filePath, firmware, nullptr, optimizations, minSuffixLength);
+}
+
+BatchGenerator::Result BatchGenerator::process(const QString &filePath, CodeGenerator::Firmware firmware,
+                                               QByteArray *output, int optimizations, int minSuffixLength)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    Result result;
+    result.filePath = filePath;
+    auto const finish = [&](Status status, QString const &message) {
+        result.status = status;
+        result.message = message;
+        result.elapsed = timer.nsecsElapsed();
+        return result;
+    };
+
+    Schema schema{Schema::Flat};
+    QString error;
+    if (!SchemaFile::load(filePath, schema, &error))
+        return finish(LoadError, error);
+
+    auto generator = createGenerator(&schema, firmware, optimizations, minSuffixLength);
+    auto const status = (output ? render(*generator, *output, &error) : prepare(*generator, &error));
+    return finish(status, error);
+}
+
+BatchGenerator::Status BatchGenerator::prepare(CodeGenerator &generator, QString *message)
+{
+    auto const verifyResult = generator.verify();
+    if (!verifyResult.first) {
+        if (message)
+            *message = QString{"Verify failed at %1"}.arg(verifyResult.second);
+        return VerifyError;
+    }
+
+    auto const prepareResult = generator.prepare();
+    if (!prepareResult.first) {
+        if (message)
+            *message = QString{"Prepare failed at %1"}.arg(prepareResult.second);
+        return PrepareError;
+    }
+    if (message)
+        *message = prepareResult.second;
+    return Success;
+}
+
+BatchGenerator::Status BatchGenerator::render(CodeGenerator &generator, QByteArray &output, QString *message)
+{
+    auto const status = prepare(generator, message);
+    if (status != Success)
+        return status;
+
+    output.clear();
+    QTextStream out{&output, QIODevice::WriteOnly};
+    generator.generate(out);
+    out.flush();
+    return Success;
+}
+
+std::vector<BatchGenerator::Result> BatchGenerator::run(const QStringList &filePaths, int threadCount) const
+{
+    std::vector<Result> results(filePaths.size());
+
+    QThreadPool pool;
+    if (threadCount > 0)
+        pool.setMaxThreadCount(threadCount);
+
+    // Only the first schema mapping to an output file may write it, the
+    // others would race it on the pool
+    QHash<QString, QString> sources;
+    for (qsizetype i = 0; i < filePaths.size(); ++i) {
+        auto const outputPath = outputPathFor(filePaths[i]);
+        auto const other = sources.constFind(outputPath);
+        if (other != sources.cend()) {
+            results[i].filePath = filePaths[i];
+            results[i].outputPath = outputPath;
+            results[i].status = WriteError;
+            results[i].message = QString{"Output %1 is already written for %2"}.arg(outputPath, *other);
+            continue;
+        }
+        sources.insert(outputPath, filePaths[i]);
+
+        pool.start([this, &filePaths, &results, i] {
+            QByteArray output;
+            auto &result = results[i];
+            result = generate(filePaths[i], m_firmware, output, m_optimizations, m_minSuffixLength);
+            result.outputPath = outputPathFor(filePaths[i]);
+            if (result.status != Success)
+                return;
+
+            QElapsedTimer timer;
+            timer.start();
+            auto const written = OutputFile::write(result.outputPath, output, &result.message);
+            if (written == OutputFile::Failed)
+                result.status = WriteError;
+            result.unchanged = written == OutputFile::Unchanged;
+            result.elapsed += timer.nsecsElapsed();
+        });
+    }
+    pool.waitForDone();
+
+    return results;
+}
+
+QString BatchGenerator::outputPathFor(const QString &filePath) const
+{
+    auto const suffix = m_firmware == CodeGenerator::ZMKFirmware ? ".dtsi" : ".h";
+    return QDir{m_outputDir}.filePath(QFileInfo{filePath}.completeBaseName() + suffix);
+}
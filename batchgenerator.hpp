@@ -0,0 +1,78 @@
+#ifndef BATCHGENERATOR_HPP
+#define BATCHGENERATOR_HPP
+
+#include "codegenerator.hpp"
+#include "zmkcodegenerator.hpp"
+#include <QByteArray>
+#include <QStringList>
+#include <vector>
+
+// Loads, verifies, prepares and generates many schema files in parallel.
+// Schemas share nothing, so each file gets its own Schema and generator on
+// a pool thread.
+class BatchGenerator
+{
+public:
+    enum Status {
+        Success,
+        LoadError,
+        VerifyError,
+        PrepareError,
+        WriteError
+    };
+
+    struct Result {
+        QString filePath{};
+        QString outputPath{};
+        Status status{Success};
+        QString message{};
+        bool unchanged{false}; // output matched the existing file, which was left alone
+        qint64 elapsed{0};     // nanoseconds
+    };
+
+public:
+    BatchGenerator(CodeGenerator::Firmware firmware, QString const &outputDir);
+
+    // Expands directories to the schema files they contain, each file once
+    static QStringList collect(QStringList const &paths);
+
+    // ZMK optimizations are applied to ZMK generators only
+    static std::unique_ptr<CodeGenerator> createGenerator(Schema *schema, CodeGenerator::Firmware firmware,
+                                                          int optimizations = ZmkCodeGenerator::DefaultOptimizations,
+                                                          int minSuffixLength = ZmkCodeGenerator::DefaultMinSuffixLength);
+
+    // Renders one schema file into output
+    static Result generate(QString const &filePath, CodeGenerator::Firmware firmware, QByteArray &output,
+                           int optimizations = ZmkCodeGenerator::DefaultOptimizations,
+                           int minSuffixLength = ZmkCodeGenerator::DefaultMinSuffixLength);
+    // Loads, verifies and prepares one schema file without rendering it
+    static Result verify(QString const &filePath, CodeGenerator::Firmware firmware,
+                         int optimizations = ZmkCodeGenerator::DefaultOptimizations,
+                         int minSuffixLength = ZmkCodeGenerator::DefaultMinSuffixLength);
+    // Verifies and prepares a generator over an already loaded schema
+    static Status prepare(CodeGenerator &generator, QString *message = nullptr);
+    // Prepares and renders with a generator over an already loaded schema
+    static Status render(CodeGenerator &generator, QByteArray &output, QString *message = nullptr);
+
+    void setOptimizations(int optimizations);
+    int optimizations() const;
+    void setMinSuffixLength(int keys);
+    int minSuffixLength() const;
+
+    std::vector<Result> run(QStringList const &filePaths, int threadCount = 0) const;
+    QString outputPathFor(QString const &filePath) const;
+    // Describes the first two schemas that map to the same output file, if any
+    QString findCollision(QStringList const &filePaths) const;
+
+private:
+    static Result process(QString const &filePath, CodeGenerator::Firmware firmware, QByteArray *output,
+                          int optimizations, int minSuffixLength);
+
+private:
+    CodeGenerator::Firmware m_firmware;
+    QString m_outputDir;
+    int m_optimizations;
+    int m_minSuffixLength;
+};
+
+#endif // BATCHGENERATOR_HPP
@@ -1,9 +1,21 @@
 #include "codegenerator.hpp"
+#include "schema.hpp"
 
 
 CodeGenerator::CodeGenerator(Schema *schema, Firmware firmware)
-    : m_schema{schema},
+    : m_ownSchema{},
+      m_schema{schema},
       m_firmware{firmware}
 {
 
 }
+
+CodeGenerator::CodeGenerator(const SchemaSnapshot &snapshot, Firmware firmware)
+    : m_ownSchema{std::make_unique<Schema>(Schema::Flat)},
+      m_schema{m_ownSchema.get()},
+      m_firmware{firmware}
+{
+    m_schema->fromSnapshot(snapshot);
+}
+
+CodeGenerator::~CodeGenerator() = default;
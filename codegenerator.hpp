@@ -3,8 +3,10 @@
 
 #include <QString>
 #include <QTextStream>
+#include <memory>
 
 class Schema;
+class SchemaSnapshot;
 
 class CodeGenerator
 {
@@ -12,13 +14,16 @@ public:
     enum Firmware {ZMKFirmware, QMKFirmware};
 public:
     CodeGenerator(Schema *schema, Firmware firmware);
-    virtual ~CodeGenerator() = default;
+    // Generates from a private copy of the snapshot, so it may run on any thread
+    CodeGenerator(SchemaSnapshot const &snapshot, Firmware firmware);
+    virtual ~CodeGenerator();
 
     virtual std::pair<bool,QString> verify() = 0;
     virtual std::pair<bool,QString> prepare() = 0;
     virtual void generate(QTextStream &out) = 0;
 
 protected:
+    std::unique_ptr<Schema> m_ownSchema;
     Schema *m_schema;
     Firmware m_firmware;
 };
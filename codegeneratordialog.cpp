@@ -12,7 +12,7 @@
 #include <QStandardPaths>
 #include "zmkcodegenerator.hpp"
 #include "qmkcodegenerator.hpp"
-#include <QFile>
+#include "outputfile.hpp"
 
 CodeGeneratorDialog::CodeGeneratorDialog(Schema *schema, CodeGenerator::Firmware firmware, QWidget *parent)
     : QDialog{parent},
@@ -79,15 +79,26 @@ void CodeGeneratorDialog::generate()
         m_log->appendPlainText(QString{"Prepare failed at %1"}.arg(verifyResult.second));
         return;
     } else {
-        m_log->appendPlainText("Prepare OK");
+        m_log->appendPlainText(prepareResult.second.isEmpty() ? QString{"Prepare OK"}
+                                                              : QString{"Prepare OK, %1"}.arg(prepareResult.second));
     }
 
-    QFile file{m_outputPath->text()};
-    if (!file.open(QFile::WriteOnly|QFile::Truncate)) {
-        m_log->appendPlainText(QString{"Failed to open file: %1"}.arg(file.errorString()));
-        return;
+    QByteArray output;
+    {
+        QTextStream out{&output, QIODevice::WriteOnly};
+        m_generator->generate(out);
     }
 
-    QTextStream out{&file};
-    m_generator->generate(out);
+    QString error;
+    switch (OutputFile::write(m_outputPath->text(), output, &error)) {
+        case OutputFile::Written:
+            m_log->appendPlainText("Output written");
+            break;
+        case OutputFile::Unchanged:
+            m_log->appendPlainText("Output unchanged, file left untouched");
+            break;
+        case OutputFile::Failed:
+            m_log->appendPlainText(QString{"Failed to write file: %1"}.arg(error));
+            break;
+    }
 }
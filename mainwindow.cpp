@@ -1,6 +1,8 @@
 #include "mainwindow.hpp"
 #include "schema.hpp"
 #include "schemamodel.hpp"
+#include "schemafile.hpp"
+#include "schemasnapshot.hpp"
 #include "schemaview.hpp"
 #include <QApplication>
 #include <QGridLayout>
@@ -19,13 +21,45 @@
 #include <QMessageBox>
 #include <QComboBox>
 #include "codegeneratordialog.hpp"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonObject>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QTimer>
+#include <QUuid>
+
+namespace {
+
+constexpr int AutosaveInterval = 60 * 1000;
+
+// A window owns an autosave for as long as it holds its lock; a lock left by
+// a process that is gone is stale and can be taken over
+std::shared_ptr<QLockFile> lockAutosave(QString const &autosavePath)
+{
+    auto lock = std::make_shared<QLockFile>(autosavePath + ".lock");
+    lock->setStaleLockTime(0);
+    if (!lock->tryLock(0))
+        return {};
+    return lock;
+}
+
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
       ui{this},
       m_schema(std::make_unique<Schema>(Schema::Flat)),
       m_model{new SchemaModel{m_schema.get(), this}},
-      m_proxyModel{new SchemaProxyModel{this}}
+      m_proxyModel{new SchemaProxyModel{this}},
+      m_autosaveTimer{new QTimer{this}},
+      m_autosavePool{new QThreadPool{this}},
+      m_instanceId{QUuid::createUuid().toString(QUuid::WithoutBraces)},
+      m_autosaveFilePath{},
+      m_autosaveLock{}
 {
     updateWindowTitle();
 
@@ -49,6 +83,7 @@ MainWindow::MainWindow(QWidget *parent)
     });
     connect(ui.regexEdit, &QLineEdit::textChanged, m_proxyModel, qOverload<QString const &>(&SchemaProxyModel::setFilterRegularExpression));
     ui.view->setModel(m_proxyModel);
+    connect(m_model, &SchemaModel::dataChanged, this, &MainWindow::updateWindowTitle);
 
     ui.view->setColumnWidth(SchemaModel::NameColumn, 150);
 
@@ -72,6 +107,12 @@ MainWindow::MainWindow(QWidget *parent)
             [this](){
                 m_proxyModel->setData(ui.view->selectionModel()->currentIndex(), ui.noteEdit->toPlainText(), SchemaModel::Note);
             });
+
+    // One worker keeps autosave writes and removals in order
+    m_autosavePool->setMaxThreadCount(1);
+    connect(m_autosaveTimer, &QTimer::timeout, this, &MainWindow::autosave);
+    m_autosaveTimer->start(AutosaveInterval);
+    QTimer::singleShot(0, this, &MainWindow::offerRecovery);
 }
 
 MainWindow::~MainWindow()
@@ -88,6 +129,7 @@ void MainWindow::closeEvent(QCloseEvent *event)
         return;
     }
 
+    removeAutosave();
     event->accept();
 }
 
@@ -100,19 +142,18 @@ bool MainWindow::save()
             QString{"%1/%2"}
                     .arg(QStandardPaths::standardLocations(QStandardPaths::HomeLocation).value(0))
                     .arg(m_schema->suggestedFileName()),
-            "All Files (*);;AMConf Files (*.amconf)");
+            "All Files (*);;AMConf Files (*.amconf);;AMConf Binary Files (*.amconfb)");
         if (filePath.isEmpty())
             return false;
     } else {
         filePath = m_schema->filePath();
     }
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly|QIODevice::Text))
+    QString error;
+    if (!SchemaFile::save(filePath, *m_schema, &error)) {
+        ui.statusBar->showMessage(QString{"Failed to save: %1"}.arg(error));
         return false;
-
-    QTextStream out(&file);
-    out << m_schema->toJson().toJson();
+    }
 
     if (m_schema->isNew()) {
         m_model->beforeSchemaChange();
@@ -122,6 +163,9 @@ bool MainWindow::save()
     }
 
     m_schema->clearChanged();
+    m_model->changesCleared();
+    removeAutosave();
+    updateWindowTitle();
     ui.statusBar->showMessage(QString{"Saved to %1"}.arg(m_schema->filePath()), 4000);
 
     return true;
@@ -132,37 +176,22 @@ bool MainWindow::open()
     QString filePath = QFileDialog::getOpenFileName(
                 this, "Open Configuration",
                 QStandardPaths::standardLocations(QStandardPaths::HomeLocation).value(0),
-                "All Files (*);;AMConf Files (*.amconf)");
+                "All Files (*);;AMConf Files (*.amconf);;AMConf Binary Files (*.amconfb)");
     if (filePath.isEmpty())
         return false;
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly|QIODevice::Text))
-        return false;
-
-    QJsonParseError error;
-    auto json = QJsonDocument::fromJson(file.readAll(), &error);
-    if (error.error != QJsonParseError::NoError) {
-        ui.statusBar->showMessage(QString{"Failed to parse document: %1"}.arg(error.errorString()));
+    // Load into a fresh schema so a broken file leaves the current one intact
+    auto schema = std::make_unique<Schema>(Schema::Flat);
+    QString error;
+    if (!SchemaFile::load(filePath, *schema, &error)) {
+        ui.statusBar->showMessage(error);
         return false;
     }
 
-    bool res = m_schema->fromJson(json);
-    if (res) {
-        m_schema->setFilePath(filePath);
-        m_model->beforeSchemaChange();
-        m_model->afterSchemaChange();
-
-        ui.noteEdit->blockSignals(true);
-        ui.noteEdit->setPlainText(ui.view->selectionModel()->currentIndex().data(SchemaModel::Note).toString());
-        ui.noteEdit->blockSignals(false);
-        ui.noteEdit->setEnabled(ui.view->selectionModel()->currentIndex().isValid());
-
-        updateWindowTitle();
-        ui.statusBar->showMessage(QString{"Opened %1"}.arg(m_schema->filePath()), 4000);
-    }
+    setSchema(std::move(schema));
+    ui.statusBar->showMessage(QString{"Opened %1"}.arg(m_schema->filePath()), 4000);
 
-    return res;
+    return true;
 }
 
 bool MainWindow::saveAs()
@@ -172,7 +201,7 @@ bool MainWindow::saveAs()
         QString{"%1/%2"}
                 .arg(QStandardPaths::standardLocations(QStandardPaths::HomeLocation).value(0))
                 .arg(m_schema->suggestedFileName()),
-        "All Files (*);;AMConf Files (*.amconf)");
+        "All Files (*);;AMConf Files (*.amconf);;AMConf Binary Files (*.amconfb)");
     if (filePath.isEmpty())
         return false;
 
@@ -185,10 +214,145 @@ void MainWindow::close()
     m_model->beforeSchemaChange();
     m_schema->clear();
     m_model->afterSchemaChange();
+    removeAutosave();
     updateWindowTitle();
     ui.statusBar->showMessage("Closed schema", 4000);
 }
 
+void MainWindow::setSchema(std::unique_ptr<Schema> schema)
+{
+    m_model->beforeSchemaChange();
+    m_schema = std::move(schema);
+    m_model->setSchema(m_schema.get());
+    m_model->afterSchemaChange();
+
+    ui.noteEdit->blockSignals(true);
+    ui.noteEdit->setPlainText(ui.view->selectionModel()->currentIndex().data(SchemaModel::Note).toString());
+    ui.noteEdit->blockSignals(false);
+    ui.noteEdit->setEnabled(ui.view->selectionModel()->currentIndex().isValid());
+
+    updateWindowTitle();
+}
+
+QString MainWindow::autosaveFilePath() const
+{
+    // One file per document, so windows and processes don't overwrite each
+    // other's; untitled schemas are told apart by the window's instance
+    auto const dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/autosave/";
+    if (m_schema->isNew())
+        return dir + "untitled-" + m_instanceId + ".amconf";
+
+    auto const path = QFileInfo{m_schema->filePath()}.absoluteFilePath().toUtf8();
+    return dir + QCryptographicHash::hash(path, QCryptographicHash::Sha1).toHex().left(16) + ".amconf";
+}
+
+void MainWindow::autosave()
+{
+    if (!m_schema->isChanged())
+        return;
+
+    // The snapshot is taken here on the GUI thread, then serialized and
+    // written on the worker; if the previous autosave is still busy this
+    // round is skipped
+    auto const filePath = autosaveFilePath();
+    auto lock = m_autosaveLock;
+    QString previous;
+    if (m_autosaveFilePath != filePath) {
+        // Another window editing the same document owns its autosave
+        QDir{}.mkpath(QFileInfo{filePath}.path());
+        lock = lockAutosave(filePath);
+        if (!lock)
+            return;
+        previous = m_autosaveFilePath;
+    }
+
+    // The previous lock is held until its file is removed
+    bool const started = m_autosavePool->tryStart([snapshot = m_schema->snapshot(), filePath, previous,
+                                                   previousLock = m_autosaveLock] {
+        // The document was renamed since its last autosave
+        if (!previous.isEmpty())
+            QFile::remove(previous);
+
+        auto json = snapshot.toJson().object();
+        json["filePath"] = snapshot.filePath();
+
+        QDir{}.mkpath(QFileInfo{filePath}.path());
+        QSaveFile file{filePath};
+        if (!file.open(QIODevice::WriteOnly|QIODevice::Text))
+            return;
+        file.write(QJsonDocument{json}.toJson());
+        file.commit();
+    });
+    if (started) {
+        m_autosaveFilePath = filePath;
+        m_autosaveLock = std::move(lock);
+    }
+}
+
+void MainWindow::removeAutosave()
+{
+    if (m_autosaveFilePath.isEmpty())
+        return;
+
+    m_autosavePool->start([filePath = std::exchange(m_autosaveFilePath, {}),
+                           lock = std::exchange(m_autosaveLock, {})] {
+        QFile::remove(filePath);
+    });
+}
+
+void MainWindow::offerRecovery()
+{
+    // Newest first; the first one restored is adopted as this window's.
+    // Autosaves still locked by a running window are left alone
+    QDir const dir{QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/autosave"};
+    for (auto const &entry: dir.entryInfoList({"*.amconf"}, QDir::Files, QDir::Time)) {
+        if (recover(entry.absoluteFilePath()))
+            return;
+    }
+}
+
+bool MainWindow::recover(const QString &autosavePath)
+{
+    auto lock = lockAutosave(autosavePath);
+    if (!lock)
+        return false;
+
+    QFile file{autosavePath};
+    if (!file.open(QIODevice::ReadOnly|QIODevice::Text))
+        return false;
+
+    auto const json = QJsonDocument::fromJson(file.readAll());
+    auto const filePath = json.object()["filePath"].toString();
+    QFileInfo const autosaved{file.fileName()};
+    QFileInfo const original{filePath};
+    file.close();
+
+    // An autosave older than its schema file was overtaken by a regular save
+    auto schema = std::make_unique<Schema>(Schema::Flat);
+    if ((original.exists() && original.lastModified() >= autosaved.lastModified()) || !schema->fromJson(json)) {
+        QFile::remove(autosavePath);
+        return false;
+    }
+
+    auto const question = QString{"Unsaved changes to %1 from %2 were recovered. Restore them?"}
+            .arg(filePath.isEmpty() ? QString{"a new schema"} : filePath)
+            .arg(autosaved.lastModified().toString());
+    if (QMessageBox::question(this, "Recover Schema", question,
+                QMessageBox::Yes|QMessageBox::No, QMessageBox::Yes) == QMessageBox::No)
+    {
+        QFile::remove(autosavePath);
+        return false;
+    }
+
+    schema->setFilePath(filePath);
+    schema->markChanged();
+    setSchema(std::move(schema));
+    m_autosaveFilePath = autosavePath;
+    m_autosaveLock = std::move(lock);
+    ui.statusBar->showMessage("Recovered autosaved changes", 4000);
+    return true;
+}
+
 void MainWindow::updateWindowTitle()
 {
     QString title{"Antecedent Morph Configurator - "};
@@ -197,7 +361,8 @@ void MainWindow::updateWindowTitle()
     else
         title += m_schema->fullName();
 
-    setWindowTitle(title);
+    setWindowTitle(title + "[*]");
+    setWindowModified(m_schema->isChanged());
 }
 
 void MainWindow::editSchemaProperties()
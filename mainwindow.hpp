@@ -2,7 +2,9 @@
 #define MAINWINDOW_HPP
 
 #include <QMainWindow>
+#include <memory>
 
+class QLockFile;
 class Schema;
 class SchemaModel;
 class SchemaProxyModel;
@@ -11,6 +13,8 @@ class SchemaView;
 class LineEdit;
 class QPlainTextEdit;
 class QComboBox;
+class QTimer;
+class QThreadPool;
 
 class MainWindow : public QMainWindow
 {
@@ -31,6 +35,12 @@ private:
 
 private:
     void setupUi();
+    void setSchema(std::unique_ptr<Schema> schema);
+    QString autosaveFilePath() const;
+    void autosave();
+    void removeAutosave();
+    void offerRecovery();
+    bool recover(QString const &autosavePath);
     void updateWindowTitle();
     void editSchemaProperties();
 
@@ -62,5 +72,10 @@ private:
     std::unique_ptr<Schema> m_schema;
     SchemaModel *m_model;
     SchemaProxyModel *m_proxyModel;
+    QTimer *m_autosaveTimer;
+    QThreadPool *m_autosavePool;
+    QString m_instanceId;
+    QString m_autosaveFilePath;
+    std::shared_ptr<QLockFile> m_autosaveLock;
 };
 #endif // MAINWINDOW_HPP
@@ -0,0 +1,35 @@
+#include "outputfile.hpp"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+OutputFile::Status OutputFile::write(const QString &filePath, const QByteArray &data, QString *errorString)
+{
+    if (isUnchanged(filePath, data))
+        return Unchanged;
+
+    QSaveFile file{filePath};
+    if (!file.open(QFile::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        if (errorString)
+            *errorString = file.errorString();
+        return Failed;
+    }
+    return Written;
+}
+
+bool OutputFile::isUnchanged(const QString &filePath, const QByteArray &data)
+{
+    QFileInfo const info{filePath};
+    if (!info.isFile() || info.size() != data.size())
+        return false;
+
+    QFile file{filePath};
+    if (!file.open(QFile::ReadOnly))
+        return false;
+
+    QCryptographicHash existing{QCryptographicHash::Sha256};
+    if (!existing.addData(&file))
+        return false;
+    return existing.result() == QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
@@ -0,0 +1,24 @@
+#ifndef OUTPUTFILE_HPP
+#define OUTPUTFILE_HPP
+
+#include <QByteArray>
+#include <QString>
+
+// Writes generated output only when it differs from the file on disk. An
+// untouched file keeps its mtime, so firmware builds depending on it are
+// not triggered for nothing. Needed writes go through QSaveFile.
+class OutputFile
+{
+public:
+    enum Status {
+        Written,
+        Unchanged,
+        Failed
+    };
+
+public:
+    static Status write(QString const &filePath, QByteArray const &data, QString *errorString = nullptr);
+    static bool isUnchanged(QString const &filePath, QByteArray const &data);
+};
+
+#endif // OUTPUTFILE_HPP
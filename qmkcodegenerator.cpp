@@ -7,6 +7,12 @@ QmkCodeGenerator::QmkCodeGenerator(Schema *schema)
 
 }
 
+QmkCodeGenerator::QmkCodeGenerator(const SchemaSnapshot &snapshot)
+    : CodeGenerator{snapshot, CodeGenerator::QMKFirmware}
+{
+
+}
+
 std::pair<bool, QString> QmkCodeGenerator::verify()
 {
     return {false, {}};
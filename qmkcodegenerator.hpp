@@ -7,6 +7,7 @@ class QmkCodeGenerator : public CodeGenerator
 {
 public:
     QmkCodeGenerator(Schema *schema);
+    QmkCodeGenerator(SchemaSnapshot const &snapshot);
     ~QmkCodeGenerator() override = default;
 
     std::pair<bool,QString> verify() override;
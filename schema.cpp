@@ -1,19 +1,263 @@
 #include "schema.hpp"
+#include "schemasnapshot.hpp"
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QHash>
+#include <QList>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <numeric>
+#include <memory>
 
-SchemaItem::SchemaItem(SchemaItem *parent)
-    : m_parent{parent}
+namespace {
+
+// Cells left at their defaults are not materialized when loading
+bool isBlank(QJsonObject const &json)
 {
+    if (json["mode"].toInt() != static_cast<int>(Mode::Text) || !json["value"].toString().isEmpty())
+        return false;
+
+    auto const mods = json["mods"].toArray();
+    for (auto const &m: mods) {
+        if (!isBlank(m.toObject()))
+            return false;
+    }
+    return true;
+}
 
+QJsonObject blankJson(int type)
+{
+    QJsonObject cell;
+    cell["type"] = type;
+    cell["mode"] = static_cast<int>(Mode::Text);
+    cell["value"] = QString{};
+    return cell;
 }
 
-int SchemaItem::row() const
+QJsonObject blankMorphJson(MorphType type)
+{
+    QJsonArray mods;
+    for (int i = 0; i < Morph::ModCount; ++i)
+        mods << blankJson(i);
+    auto morph = blankJson(static_cast<int>(type));
+    morph["mods"] = mods;
+    return morph;
+}
+
+bool isBlankLayer(QJsonObject const &json)
+{
+    auto const morphs = json["morphs"].toArray();
+    return std::all_of(morphs.begin(), morphs.end(),
+                       [](QJsonValue const &m) { return isBlank(m.toObject()); });
+}
+
+QJsonObject blankLayerJson(LayerType type)
+{
+    // Left-hand layers hold the west morphs, see Layer::morphTypeAt()
+    int const first = type >= LayerType::Function ? static_cast<int>(MorphType::NorthWest) : 0;
+    QJsonArray morphs;
+    for (int i = 0; i < Layer::morphCount(type); ++i)
+        morphs << blankMorphJson(static_cast<MorphType>(first + i));
+    QJsonObject layer;
+    layer["type"] = static_cast<int>(type);
+    layer["morphs"] = morphs;
+    return layer;
+}
+
+// Stable identifiers used by the sparse JSON format
+constexpr QLatin1StringView LayerKeys[] = {
+    QLatin1StringView{"base"}, QLatin1StringView{"mouse"}, QLatin1StringView{"nav"},
+    QLatin1StringView{"media"}, QLatin1StringView{"function"}, QLatin1StringView{"number"},
+    QLatin1StringView{"symbol"}
+};
+static_assert(std::size(LayerKeys) == Antecedent::LayerCount);
+
+constexpr QLatin1StringView MorphKeys[] = {
+    QLatin1StringView{"ne"}, QLatin1StringView{"e"}, QLatin1StringView{"se"},
+    QLatin1StringView{"nw"}, QLatin1StringView{"w"}, QLatin1StringView{"sw"}
+};
+static_assert(std::size(MorphKeys) == Layer::MaxMorphCount);
+
+constexpr QLatin1StringView ModKeys[] = {
+    QLatin1StringView{"ctrl"}, QLatin1StringView{"alt"}, QLatin1StringView{"gui"}
+};
+static_assert(std::size(ModKeys) == Morph::ModCount);
+
+// .amconfb layout, little-endian throughout: the header, note records and
+// cell records, then a UTF-8 string table the records point into
+constexpr char BinaryMagic[] = {'A', 'M', 'C', 'B'};
+constexpr quint16 BinaryFormat = 1;
+// BinaryCell::mod of a record holding the morph itself
+constexpr quint8 MorphCell = 0xff;
+
+struct BinaryString {
+    quint32_le offset;
+    quint32_le size;
+};
+
+struct BinaryHeader {
+    char magic[4];
+    quint16_le format;
+    quint16_le type;
+    BinaryString name;
+    BinaryString version;
+    BinaryString prefix;
+    quint32_le noteCount;
+    quint32_le cellCount;
+    quint32_le stringsSize;
+    quint32_le reserved;
+};
+static_assert(sizeof(BinaryHeader) == 48);
+
+struct BinaryNote {
+    quint8 antecedent;
+    quint8 reserved[3];
+    BinaryString text;
+};
+static_assert(sizeof(BinaryNote) == 12);
+
+// Only cells that differ from the defaults are stored
+struct BinaryCell {
+    quint8 antecedent;
+    quint8 layer;
+    quint8 morph;
+    quint8 mod;
+    quint8 mode;
+    quint8 reserved[3];
+    BinaryString value;
+};
+static_assert(sizeof(BinaryCell) == 16);
+
+class BinaryStringTable
+{
+public:
+    BinaryString add(QString const &string)
+    {
+        if (string.isEmpty())
+            return {};
+
+        auto const utf8 = string.toUtf8();
+        auto offset = m_offsets.value(string, -1);
+        if (offset < 0) {
+            offset = m_data.size();
+            m_offsets.insert(string, offset);
+            m_data += utf8;
+        }
+        return {static_cast<quint32>(offset), static_cast<quint32>(utf8.size())};
+    }
+
+    QByteArray const &data() const { return m_data; }
+
+private:
+    QHash<QString, qsizetype> m_offsets;
+    QByteArray m_data;
+};
+
+template <typename T>
+void appendRecords(QByteArray &out, QList<T> const &records)
+{
+    out.append(reinterpret_cast<char const*>(records.data()), records.size() * sizeof(T));
+}
+
+// Indexed by Antecedent::Type
+constexpr QStringView Symbols[] = {
+    u"A", u"B", u"C", u"D", u"E", u"F", u"G", u"H", u"I", u"J", u"K", u"L", u"M",
+    u"N", u"O", u"P", u"Q", u"R", u"S", u"T", u"U", u"V", u"W", u"X", u"Y", u"Z",
+    u"0", u"1", u"2", u"3", u"4", u"5", u"6", u"7", u"8", u"9",
+    u",", u".", u"'", u"/",
+    u"{", u"}", u"(", u")", u"*",
+    u":", u"$", u"%", u"^", u"+",
+    u"~", u"!", u"@", u"#", u"|",
+    u"&", u"_",
+    u"[", u"]", u";", u"`", u"=", u"\\", u"-", u" "
+};
+static_assert(std::size(Symbols) == Schema::AntecedentCount);
+
+constexpr QStringView ZmkCodes[] = {
+    u"A", u"B", u"C", u"D", u"E", u"F", u"G", u"H", u"I", u"J", u"K", u"L", u"M",
+    u"N", u"O", u"P", u"Q", u"R", u"S", u"T", u"U", u"V", u"W", u"X", u"Y", u"Z",
+    u"N0", u"N1", u"N2", u"N3", u"N4", u"N5", u"N6", u"N7", u"N8", u"N9",
+    u"COMMA", u"DOT", u"SQT", u"FSLH",
+    u"LBRC", u"RBRC", u"LPAR", u"RPAR", u"STAR",
+    u"COLON", u"DLLR", u"PRCNT", u"CARET", u"PLUS",
+    u"TILDE", u"EXCL", u"AT", u"HASH", u"PIPE",
+    u"AMPS", u"UNDER",
+    u"LBKT", u"RBKT", u"SEMI", u"GRAVE", u"EQUAL", u"BSLH", u"MINUS", u"SPACE"
+};
+static_assert(std::size(ZmkCodes) == Schema::AntecedentCount);
+
+constexpr QStringView QmkCodes[] = {
+    u"KC_A", u"KC_B", u"KC_C", u"KC_D", u"KC_E", u"KC_F", u"KC_G", u"KC_H", u"KC_I", u"KC_J", u"KC_K", u"KC_L", u"KC_M",
+    u"KC_N", u"KC_O", u"KC_P", u"KC_Q", u"KC_R", u"KC_S", u"KC_T", u"KC_U", u"KC_V", u"KC_W", u"KC_X", u"KC_Y", u"KC_Z",
+    u"KC_0", u"KC_1", u"KC_2", u"KC_3", u"KC_4", u"KC_5", u"KC_6", u"KC_7", u"KC_8", u"KC_9",
+    u"KC_COMM", u"KC_DOT", u"KC_QUOT", u"KC_SLSH",
+    u"KC_LCBR", u"KC_RCBR", u"KC_LPRN", u"KC_RPRN", u"KC_ASTR",
+    u"KC_COLN", u"KC_DLR", u"KC_PERC", u"KC_CIRC", u"KC_PLUS",
+    u"KC_TILD", u"KC_EXLM", u"KC_AT", u"KC_HASH", u"KC_PIPE",
+    u"KC_AMPR", u"KC_UNDS",
+    u"KC_LBRC", u"KC_RBRC", u"KC_SCLN", u"KC_GRV", u"KC_EQL", u"KC_BSLS", u"KC_MINS", u"KC_SPC"
+};
+static_assert(std::size(QmkCodes) == Schema::AntecedentCount);
+
+bool isValidType(int type)
+{
+    return type >= 0 && type < Schema::AntecedentCount;
+}
+
+bool isValidMode(int mode)
+{
+    return mode >= static_cast<int>(Mode::Text) && mode <= static_cast<int>(Mode::SchemaName);
+}
+
+// Checks every "mode" below value, whichever format it is laid out in
+bool hasValidModes(QJsonValue const &value)
+{
+    if (value.isArray()) {
+        for (auto const &v: value.toArray()) {
+            if (!hasValidModes(v))
+                return false;
+        }
+        return true;
+    }
+    if (!value.isObject())
+        return true;
+
+    auto const object = value.toObject();
+    if (object.contains("mode") && !isValidMode(object["mode"].toInt()))
+        return false;
+    for (auto const &v: object) {
+        if (!hasValidModes(v))
+            return false;
+    }
+    return true;
+}
+
+constexpr AntecedentSet RightHand = [] {
+    AntecedentSet set;
+    for (auto type: {Antecedent::J, Antecedent::L, Antecedent::U, Antecedent::Y, Antecedent::Quote,
+                     Antecedent::M, Antecedent::N, Antecedent::E, Antecedent::I, Antecedent::O,
+                     Antecedent::K, Antecedent::H, Antecedent::Comma, Antecedent::Dot, Antecedent::Slash,
+                     Antecedent::Space})
+        set.insert(type);
+    return set;
+}();
+
+}
+
+SchemaItem::SchemaItem(SchemaItem *parent, int row)
+    : m_parent{parent},
+      m_row{row},
+      m_changed{false},
+      m_changedBelow{0}
 {
-    if (!m_parent)
-        return 0;
 
-    return m_parent->rowOf(this);
+}
+
+int SchemaItem::row() const
+{
+    return m_row;
 }
 
 SchemaItem *SchemaItem::parent()
@@ -93,6 +337,47 @@ Modifier SchemaItem::pressedModifier() const
     return NoModifier;
 }
 
+bool SchemaItem::isChanged() const
+{
+    return m_changed || m_changedBelow > 0;
+}
+
+void SchemaItem::setChanged()
+{
+    invalidate();
+    if (m_changed)
+        return;
+
+    m_changed = true;
+    for (auto *p = m_parent; p; p = p->m_parent)
+        ++p->m_changedBelow;
+}
+
+void SchemaItem::resetChanged()
+{
+    if (!m_changed)
+        return;
+
+    m_changed = false;
+    for (auto *p = m_parent; p; p = p->m_parent)
+        --p->m_changedBelow;
+}
+
+SchemaArena &SchemaItem::arena()
+{
+    return m_parent->arena();
+}
+
+void SchemaItem::invalidate()
+{
+    m_parent->invalidate();
+}
+
+void SchemaItem::setPopulated(int antecedentType, LayerType layerType, MorphType morphType, int modType, bool populated)
+{
+    m_parent->setPopulated(antecedentType, layerType, morphType, modType, populated);
+}
+
 Schema::Schema(Type type, SchemaItem *parent)
     : SchemaItem{parent},
       m_filePath{},
@@ -100,12 +385,32 @@ Schema::Schema(Type type, SchemaItem *parent)
       m_version{},
       m_type{type},
       m_prefix{},
+      m_arena{},
+      m_cells{},
       m_antecedents{},
-      m_changed{false}
+      m_snapshot{}
+{
+    static_assert(AntecedentCount == Antecedent::Space + 1);
+    static_assert(AntecedentCount <= AntecedentSet::WordCount * 64);
+
+    // Antecedents and their base layers are fixed; deep layers, morphs and
+    // mods are materialized behind them only when touched
+    m_arena.reserve(SchemaArena::footprint<Antecedent>(AntecedentCount)
+                    + SchemaArena::footprint<Layer>(AntecedentCount));
+    auto *antecedents = m_arena.allocate<Antecedent>(AntecedentCount);
+    auto *layers = m_arena.allocate<Layer>(AntecedentCount);
+    m_cells = m_arena.mark();
+
+    for (int type = Antecedent::A; type <= Antecedent::Space; ++type) {
+        new (antecedents + type) Antecedent{static_cast<Antecedent::Type>(type), this,
+                layers + type};
+    }
+    m_antecedents = {antecedents, AntecedentCount};
+}
+
+Schema::~Schema()
 {
-    m_antecedents.reserve(Antecedent::Space+1);
-    for (int type = Antecedent::A; type <= Antecedent::Space; ++type)
-        m_antecedents.push_back(std::make_unique<Antecedent>(static_cast<Antecedent::Type>(type), this));
+    std::destroy(m_antecedents.begin(), m_antecedents.end());
 }
 
 bool Schema::isNew() const
@@ -119,6 +424,7 @@ bool Schema::setFilePath(QString filePath)
         return false;
 
     m_filePath = filePath;
+    invalidate();
     return true;
 }
 
@@ -138,39 +444,266 @@ bool Schema::fromJson(const QJsonDocument &jsonDoc)
         return false;
 
     auto schema = jsonDoc.object();
+    int const format = schema["format"].toInt(1);
+    if (format < 1 || format > Format)
+        return false;
+
+    // Item types come from the slots they are loaded into, only the schema
+    // type and the modes are taken from the document
+    int const type = schema["type"].toInt();
+    if ((type != Flat && type != Deep) || !hasValidModes(schema["antecedents"]))
+        return false;
+
+    std::for_each(m_antecedents.begin(), m_antecedents.end(),
+                  [](Antecedent &a) { a.clear(); });
+    m_arena.rewind(m_cells);
+
     m_name = schema["name"].toString();
     m_version = schema["version"].toString();
-    m_type = static_cast<Type>(schema["type"].toInt());
+    m_type = static_cast<Type>(type);
     m_prefix = schema["prefix"].toString();
-    m_changed = false;
+    resetChanged();
 
     auto antecedents = schema["antecedents"].toObject();
     for (auto &a : m_antecedents) {
-        auto const key = QString::number(a->type());
-        if (antecedents.contains(key))
-            a->fromJson(antecedents[key].toObject());
+        if (format == 1) {
+            auto const key = QString::number(a.type());
+            if (antecedents.contains(key))
+                a.fromJson(antecedents[key].toObject());
+        } else {
+            auto const key = a.zmkCode().toString();
+            if (antecedents.contains(key))
+                a.fromSparseJson(antecedents[key].toObject());
+        }
     }
 
     return true;
 }
 
-QJsonDocument Schema::toJson()
+QJsonDocument Schema::toJson(int format)
 {
+    if (format != 1)
+        return snapshot().toJson();
+
     QJsonObject schema;
-    schema["format"] = 1;
+    schema["format"] = format;
     schema["name"] = m_name;
     schema["version"] = m_version;
     schema["type"] = m_type;
     schema["prefix"] = m_prefix;
     QJsonObject antecedents;
     for (auto const &a : m_antecedents) {
-        antecedents[QString::number(a->type())] = a->toJson(m_type);
+        antecedents[QString::number(a.type())] = a.toJson(m_type);
     }
     schema["antecedents"] = antecedents;
 
     return QJsonDocument{schema};
 }
 
+SchemaSnapshot Schema::snapshot() const
+{
+    if (m_snapshot)
+        return *m_snapshot;
+
+    // Unchanged antecedents hand out their cached JSON, so only the ones
+    // edited since the last snapshot are copied
+    auto data = std::make_shared<SchemaSnapshot::Data>();
+    data->filePath = m_filePath;
+    data->name = m_name;
+    data->version = m_version;
+    data->type = m_type;
+    data->prefix = m_prefix;
+    for (auto const &a : m_antecedents)
+        data->antecedents[a.type()] = a.toSparseJson(m_type);
+
+    m_snapshot = std::make_unique<SchemaSnapshot>(SchemaSnapshot{std::move(data)});
+    return *m_snapshot;
+}
+
+bool Schema::fromSnapshot(const SchemaSnapshot &snapshot)
+{
+    if (snapshot.isNull())
+        return false;
+
+    std::for_each(m_antecedents.begin(), m_antecedents.end(),
+                  [](Antecedent &a) { a.clear(); });
+    m_arena.rewind(m_cells);
+
+    m_filePath = snapshot.filePath();
+    m_name = snapshot.name();
+    m_version = snapshot.version();
+    m_type = snapshot.type();
+    m_prefix = snapshot.prefix();
+    resetChanged();
+
+    for (auto &a : m_antecedents)
+        a.fromSparseJson(snapshot.antecedent(a.type()));
+
+    m_snapshot = std::make_unique<SchemaSnapshot>(snapshot);
+    return true;
+}
+
+bool Schema::isBinary(QByteArrayView data)
+{
+    return data.size() >= qsizetype(std::size(BinaryMagic))
+            && std::equal(std::begin(BinaryMagic), std::end(BinaryMagic), data.begin());
+}
+
+bool Schema::fromBinary(QByteArrayView data)
+{
+    // Records are read in place, which needs them aligned
+    if (reinterpret_cast<quintptr>(data.data()) % alignof(BinaryHeader))
+        return fromBinary(QByteArray{data.data(), data.size()});
+
+    if (data.size() < qsizetype(sizeof(BinaryHeader)))
+        return false;
+
+    auto const *header = reinterpret_cast<BinaryHeader const*>(data.data());
+    if (!isBinary(data) || header->format != BinaryFormat || header->type > Deep)
+        return false;
+
+    quint64 const size = sizeof(BinaryHeader) + quint64{header->noteCount} * sizeof(BinaryNote)
+            + quint64{header->cellCount} * sizeof(BinaryCell) + header->stringsSize;
+    if (size != quint64(data.size()))
+        return false;
+
+    auto const *notes = reinterpret_cast<BinaryNote const*>(header + 1);
+    auto const *cells = reinterpret_cast<BinaryCell const*>(notes + header->noteCount);
+    auto const *strings = reinterpret_cast<char const*>(cells + header->cellCount);
+    auto const notesEnd = notes + header->noteCount;
+    auto const cellsEnd = cells + header->cellCount;
+
+    auto const isValidString = [header](BinaryString const &s) {
+        return quint64{s.offset} + s.size <= header->stringsSize;
+    };
+    auto const string = [strings](BinaryString const &s) {
+        return QString::fromUtf8(strings + s.offset, s.size);
+    };
+
+    // Validate everything up front so a bad file leaves the schema untouched
+    if (!isValidString(header->name) || !isValidString(header->version) || !isValidString(header->prefix))
+        return false;
+    bool const notesValid = std::all_of(notes, notesEnd, [&](BinaryNote const &n) {
+        return n.antecedent < AntecedentCount && isValidString(n.text);
+    });
+    bool const cellsValid = std::all_of(cells, cellsEnd, [&](BinaryCell const &c) {
+        return c.antecedent < AntecedentCount && c.layer < Antecedent::LayerCount
+                && c.morph < Layer::morphCount(static_cast<LayerType>(c.layer))
+                && (c.mod == MorphCell || c.mod < Morph::ModCount)
+                && c.mode <= static_cast<int>(Mode::SchemaName) && isValidString(c.value);
+    });
+    if (!notesValid || !cellsValid)
+        return false;
+
+    std::for_each(m_antecedents.begin(), m_antecedents.end(),
+                  [](Antecedent &a) { a.clear(); });
+    m_arena.rewind(m_cells);
+
+    m_name = string(header->name);
+    m_version = string(header->version);
+    m_type = static_cast<Type>(quint16{header->type});
+    m_prefix = string(header->prefix);
+
+    for (auto const *n = notes; n != notesEnd; ++n)
+        m_antecedents[n->antecedent].setAntecedentNote(string(n->text));
+
+    for (auto const *c = cells; c != cellsEnd; ++c) {
+        auto *item = m_antecedents[c->antecedent].child(c->layer)->child(c->morph);
+        if (c->mod != MorphCell)
+            item = item->child(c->mod);
+        item->setMode(c->mode);
+        item->setValue(string(c->value));
+    }
+
+    resetChanged();
+    clearChanged();
+    return true;
+}
+
+QByteArray Schema::toBinary()
+{
+    BinaryStringTable strings;
+    QList<BinaryNote> notes;
+    QList<BinaryCell> cells;
+
+    // Same content as toJson(): layers beyond the schema type are left out
+    for (auto &a : m_antecedents) {
+        if (!a.antecedentNote().isEmpty())
+            notes.append(BinaryNote{static_cast<quint8>(a.type()), {}, strings.add(a.antecedentNote())});
+
+        for (int l = 0; l < a.childCount(m_type); ++l) {
+            auto const *layer = static_cast<Layer*>(a.child(l));
+            for (auto const &m : layer->morphs()) {
+                auto const addCell = [&](SchemaItem const &item, quint8 mod) {
+                    if (item.mode() == static_cast<int>(Mode::Text) && item.value().isEmpty())
+                        return;
+                    cells.append(BinaryCell{static_cast<quint8>(a.type()), static_cast<quint8>(l),
+                                  static_cast<quint8>(m.row()), mod,
+                                  static_cast<quint8>(item.mode()), {}, strings.add(item.value())});
+                };
+                addCell(m, MorphCell);
+                for (auto const &d : m.mods())
+                    addCell(d, static_cast<quint8>(d.row()));
+            }
+        }
+    }
+
+    BinaryHeader header{};
+    std::copy(std::begin(BinaryMagic), std::end(BinaryMagic), header.magic);
+    header.format = BinaryFormat;
+    header.type = static_cast<quint16>(m_type);
+    header.name = strings.add(m_name);
+    header.version = strings.add(m_version);
+    header.prefix = strings.add(m_prefix);
+    header.noteCount = static_cast<quint32>(notes.size());
+    header.cellCount = static_cast<quint32>(cells.size());
+    header.stringsSize = static_cast<quint32>(strings.data().size());
+
+    QByteArray out;
+    out.reserve(sizeof(header) + notes.size() * sizeof(BinaryNote)
+                + cells.size() * sizeof(BinaryCell) + strings.data().size());
+    out.append(reinterpret_cast<char const*>(&header), sizeof(header));
+    appendRecords(out, notes);
+    appendRecords(out, cells);
+    out += strings.data();
+    return out;
+}
+
+QByteArray Schema::toJsonData()
+{
+    QJsonObject schema;
+    schema["format"] = Format;
+    schema["name"] = m_name;
+    schema["version"] = m_version;
+    schema["type"] = m_type;
+    schema["prefix"] = m_prefix;
+    auto const rest = QJsonDocument{schema}.toJson();
+
+    // QJsonObject keeps its keys sorted: "antecedents" opens the document and
+    // antecedents follow their ZMK codes
+    static auto const order = [] {
+        std::array<int, AntecedentCount> order;
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [](int a, int b) { return ZmkCodes[a].compare(ZmkCodes[b]) < 0; });
+        return order;
+    }();
+
+    QByteArray json{"{\n    \"antecedents\": {\n"};
+    bool empty{true};
+    for (int type : order) {
+        auto const &fragment = m_antecedents[type].jsonFragment(m_type);
+        if (fragment.isEmpty())
+            continue;
+        if (!empty)
+            json += ",\n";
+        json += fragment;
+        empty = false;
+    }
+    json += empty ? "    },\n" : "\n    },\n";
+    json += rest.mid(2);
+    return json;
+}
+
 void Schema::clear()
 {
     m_filePath.clear();
@@ -178,9 +711,10 @@ void Schema::clear()
     m_version.clear();
     m_type = Flat;
     m_prefix.clear();
-    m_changed = false;
-    std::for_each(m_antecedents.cbegin(), m_antecedents.cend(),
-                  [](std::unique_ptr<Antecedent> const &a) { a->clear(); });
+    resetChanged();
+    std::for_each(m_antecedents.begin(), m_antecedents.end(),
+                  [](Antecedent &a) { a.clear(); });
+    m_arena.rewind(m_cells);
 }
 
 bool Schema::setName(const QString &name)
@@ -189,7 +723,7 @@ bool Schema::setName(const QString &name)
         return false;
 
     m_name = name;
-    m_changed = true;
+    setChanged();
     return true;
 }
 
@@ -204,7 +738,7 @@ bool Schema::setVersion(const QString &version)
         return false;
 
     m_version = version;
-    m_changed = true;
+    setChanged();
     return true;
 }
 
@@ -219,7 +753,7 @@ bool Schema::setType(Type type)
         return false;
 
     m_type = type;
-    m_changed = true;
+    setChanged();
     return true;
 }
 
@@ -229,7 +763,7 @@ bool Schema::setPrefix(const QString &prefix)
         return false;
 
     m_prefix = prefix;
-    m_changed = true;
+    setChanged();
     return true;
 }
 
@@ -240,22 +774,22 @@ QString Schema::prefix() const
 
 bool Schema::isEmpty(LayerType layerType, MorphType morphType) const
 {
-    for (auto const &a: m_antecedents) {
-        if (!a->isEmpty(layerType, morphType))
-            return false;
-    }
-
-    return true;
+    return populated(layerType, morphType).isEmpty();
 }
 
 bool Schema::isEmpty(LayerType layerType, MorphType morphType, ModType modType) const
 {
-    for (auto const &a: m_antecedents) {
-        if (!a->isEmpty(layerType, morphType, modType))
-            return false;
-    }
+    return populated(layerType, morphType, modType).isEmpty();
+}
 
-    return true;
+AntecedentSet const &Schema::populated(LayerType layerType, MorphType morphType) const
+{
+    return m_population[bucket(layerType, morphType, -1)];
+}
+
+AntecedentSet const &Schema::populated(LayerType layerType, MorphType morphType, ModType modType) const
+{
+    return m_population[bucket(layerType, morphType, static_cast<int>(modType))];
 }
 
 SchemaItem::Kind Schema::kind() const
@@ -270,13 +804,13 @@ Schema::Type Schema::type() const
 
 SchemaItem *Schema::child(int row)
 {
-    return m_antecedents[row].get();
+    return &m_antecedents[row];
 }
 
 int Schema::childCount(int schemaType) const
 {
     Q_UNUSED(schemaType)
-    return int(m_antecedents.size());
+    return m_antecedents.size();
 }
 
 int Schema::itemType() const
@@ -294,23 +828,20 @@ bool Schema::isRight() const
     return false;
 }
 
-bool Schema::isChanged() const
+void Schema::markChanged()
 {
-    if (m_changed)
-        return true;
-
-    for (auto const &a : m_antecedents)
-        if (a->isChanged())
-            return true;
-
-    return false;
+    setChanged();
 }
 
 void Schema::clearChanged()
 {
-    m_changed = false;
+    if (!isChanged())
+        return;
+
+    resetChanged();
     for (auto &a : m_antecedents)
-        a->clearChanged();
+        if (a.isChanged())
+            a.clearChanged();
 }
 
 int Schema::antecedentType() const
@@ -318,45 +849,70 @@ int Schema::antecedentType() const
     return -1;
 }
 
-int Schema::rowOf(SchemaItem const *me) const
+SchemaArena &Schema::arena()
 {
-    auto const it = std::find_if(m_antecedents.cbegin(), m_antecedents.cend(),
-                        [me](std::unique_ptr<Antecedent> const &item) {
-                            return item.get() == me;
-                        });
-    if (it != m_antecedents.cend())
-        return std::distance(m_antecedents.cbegin(), it);
+    return m_arena;
+}
 
-    Q_ASSERT(false && "Should not happen");
-    return -1;
+void Schema::invalidate()
+{
+    m_snapshot.reset();
 }
 
-Antecedent::Antecedent(Type type, SchemaItem *parent)
-    : SchemaItem{parent},
+void Schema::setPopulated(int antecedentType, LayerType layerType, MorphType morphType, int modType, bool populated)
+{
+    auto &set = m_population[bucket(layerType, morphType, modType)];
+    if (populated)
+        set.insert(antecedentType);
+    else
+        set.remove(antecedentType);
+}
+
+int Schema::bucket(LayerType layerType, MorphType morphType, int modType)
+{
+    return (static_cast<int>(layerType) * 6 + static_cast<int>(morphType)) * 4 + modType + 1;
+}
+
+Antecedent::Antecedent(Type type, SchemaItem *parent, Layer *base)
+    : SchemaItem{parent, type},
       m_type{type},
       m_layers{},
       m_note{},
-      m_changed{false}
+      m_json{},
+      m_jsonSchemaType{-1},
+      m_fragment{},
+      m_fragmentSchemaType{-1}
+{
+    m_layers[0] = new (base) Layer{LayerType::Base, this};
+}
+
+Antecedent::~Antecedent()
+{
+    for (auto *l : m_layers)
+        if (l)
+            std::destroy_at(l);
+}
+
+SchemaItemSlots<Layer> Antecedent::layers() const
 {
-    m_layers.push_back(std::make_unique<Layer>(LayerType::Base, this));
-    m_layers.push_back(std::make_unique<Layer>(LayerType::Mouse, this));
-    m_layers.push_back(std::make_unique<Layer>(LayerType::Navigation, this));
-    m_layers.push_back(std::make_unique<Layer>(LayerType::Media, this));
-    m_layers.push_back(std::make_unique<Layer>(LayerType::Function, this));
-    m_layers.push_back(std::make_unique<Layer>(LayerType::Number, this));
-    m_layers.push_back(std::make_unique<Layer>(LayerType::Symbol, this));
+    return {m_layers, LayerCount};
 }
 
 bool Antecedent::fromJson(const QJsonObject &json)
 {
-    m_type = static_cast<Type>(json["type"].toInt());
+    // The type is the slot's; the document's "type" only repeats its key
     m_note = json["note"].toVariant().toString();
-    m_changed = false;
+    resetChanged();
+    invalidate();
 
     int i{0};
     auto const layers = json["layers"].toArray();
     for (auto const &l: layers) {
-        m_layers[i]->fromJson(l.toObject());
+        if (i == LayerCount)
+            break;
+        auto const layer = l.toObject();
+        if (m_layers[i] || !isBlankLayer(layer))
+            materialize(i)->fromJson(layer);
         ++i;
     }
     return true;
@@ -366,7 +922,7 @@ QJsonObject Antecedent::toJson(int schemaType) const
 {
     QJsonArray layers;
     for (int i = 0; i < childCount(schemaType); ++i) {
-        layers << m_layers[i]->toJson();
+        layers << (m_layers[i] ? m_layers[i]->toJson() : blankLayerJson(static_cast<LayerType>(i)));
     }
     QJsonObject antecedent;
     antecedent["type"] = m_type;
@@ -375,32 +931,98 @@ QJsonObject Antecedent::toJson(int schemaType) const
     return antecedent;
 }
 
+bool Antecedent::fromSparseJson(const QJsonObject &json)
+{
+    m_note = json["note"].toString();
+    resetChanged();
+    invalidate();
+
+    for (int i = 0; i < LayerCount; ++i) {
+        auto const layer = json[Layer::key(static_cast<LayerType>(i))];
+        if (layer.isObject())
+            materialize(i)->fromSparseJson(layer.toObject());
+    }
+    return true;
+}
+
+QJsonObject Antecedent::toSparseJson(int schemaType) const
+{
+    if (m_jsonSchemaType == schemaType)
+        return m_json;
+
+    QJsonObject antecedent;
+    if (!m_note.isEmpty())
+        antecedent["note"] = m_note;
+    for (int i = 0; i < childCount(schemaType); ++i) {
+        if (!m_layers[i])
+            continue;
+        auto const layer = m_layers[i]->toSparseJson();
+        if (!layer.isEmpty())
+            antecedent[Layer::key(static_cast<LayerType>(i))] = layer;
+    }
+    m_json = antecedent;
+    m_jsonSchemaType = schemaType;
+    return antecedent;
+}
+
+QByteArray const &Antecedent::jsonFragment(int schemaType) const
+{
+    if (m_fragmentSchemaType == schemaType)
+        return m_fragment;
+
+    // The member as QJsonDocument would indent it inside "antecedents"
+    m_fragment.clear();
+    m_fragmentSchemaType = schemaType;
+    auto const json = toSparseJson(schemaType);
+    if (json.isEmpty())
+        return m_fragment;
+
+    auto object = QJsonDocument{json}.toJson();
+    object.chop(1);
+    object.replace("\n", "\n        ");
+    m_fragment = "        \"" + zmkCode().toLatin1() + "\": " + object;
+    return m_fragment;
+}
+
 void Antecedent::clear()
 {
     m_note.clear();
-    m_changed = false;
-    std::for_each(m_layers.cbegin(), m_layers.cend(),
-                  [](std::unique_ptr<Layer> const &l) { l->clear(); });
+    resetChanged();
+    invalidate();
+    m_layers[0]->clear();
+
+    // Deep layers sit past the schema's rewind mark
+    for (int i = 1; i < LayerCount; ++i) {
+        if (!m_layers[i])
+            continue;
+        m_layers[i]->clear();
+        std::destroy_at(m_layers[i]);
+        m_layers[i] = nullptr;
+    }
 }
 
 bool Antecedent::isEmpty(LayerType layerType, MorphType morphType) const
 {
-    return m_layers[static_cast<int>(layerType)]->isEmpty(morphType);
+    auto const *l = m_layers[static_cast<int>(layerType)];
+    return !l || l->isEmpty(morphType);
 }
 
 bool Antecedent::isEmpty(LayerType layerType, MorphType morphType, ModType modType) const
 {
-    return m_layers[static_cast<int>(layerType)]->isEmpty(morphType, modType);
+    auto const *l = m_layers[static_cast<int>(layerType)];
+    return !l || l->isEmpty(morphType, modType);
 }
 
 Morph *Antecedent::getMorph(LayerType layerType, MorphType morphType) const
 {
-    return m_layers[static_cast<int>(layerType)]->getMorph(morphType);
+    auto const *l = m_layers[static_cast<int>(layerType)];
+    return l ? l->getMorph(morphType) : nullptr;
 }
 
 Mod *Antecedent::getMod(LayerType layerType, MorphType morphType, ModType modType) const
 {
-    return m_layers[static_cast<int>(layerType)]->getMod(morphType, modType);
+    auto const *l = m_layers[static_cast<int>(layerType)];
+    return l ? l->getMod(morphType, modType) : nullptr;
 }
 
 SchemaItem::Kind Antecedent::kind() const
@@ -415,7 +1037,7 @@ Antecedent::Type Antecedent::type() const
 
 SchemaItem *Antecedent::child(int row)
 {
-    return m_layers[row].get();
+    return materialize(row);
 }
 
 int Antecedent::childCount(int schemaType) const
@@ -423,7 +1045,7 @@ int Antecedent::childCount(int schemaType) const
     if (schemaType == Schema::Flat)
         return 1;
 
-    return int(m_layers.size());
+    return LayerCount;
 }
 
 int Antecedent::itemType() const
@@ -433,56 +1055,42 @@ int Antecedent::itemType() const
 
 QString Antecedent::name() const
 {
-    return symbol(m_type);
+    return symbol(m_type).toString();
 }
 
 bool Antecedent::isRight() const
 {
-    switch (m_type) {
-        case J:
-        case L:
-        case U:
-        case Y:
-        case Quote:
-        case M:
-        case N:
-        case E:
-        case I:
-        case O:
-        case K:
-        case H:
-        case Comma:
-        case Dot:
-        case Slash:
-        case Space:
-            return true;
-        default:
-            return false;
-    }
+    return RightHand.contains(m_type);
 }
 
-bool Antecedent::isChanged() const
+void Antecedent::clearChanged()
 {
-    if (m_changed)
-        return true;
+    if (!isChanged())
+        return;
 
-    for (auto const &l : m_layers)
-        if (l->isChanged())
-            return true;
+    resetChanged();
+    for (auto &l : layers())
+        if (l.isChanged())
+            l.clearChanged();
+}
 
-    return false;
+int Antecedent::antecedentType() const
+{
+    return m_type;
 }
 
-void Antecedent::clearChanged()
+Layer *Antecedent::materialize(int row)
 {
-    m_changed = false;
-    for (auto &l : m_layers)
-        l->clearChanged();
+    if (!m_layers[row])
+        m_layers[row] = new (arena().allocate<Layer>(1)) Layer{static_cast<LayerType>(row), this};
+    return m_layers[row];
 }
 
-int Antecedent::antecedentType() const
+void Antecedent::invalidate()
 {
-    return m_type;
+    m_jsonSchemaType = -1;
+    m_fragmentSchemaType = -1;
+    SchemaItem::invalidate();
 }
 
 bool Antecedent::setAntecedentNote(const QString &note)
@@ -491,7 +1099,7 @@ bool Antecedent::setAntecedentNote(const QString &note)
         return false;
 
     m_note = note;
-    m_changed = true;
+    setChanged();
     return true;
 }
 
@@ -500,272 +1108,73 @@ QString Antecedent::antecedentNote() const
     return m_note;
 }
 
-QString Antecedent::symbol() const
+QStringView Antecedent::symbol() const
 {
     return symbol(m_type);
 }
 
-QString Antecedent::zmkCode() const
+QStringView Antecedent::zmkCode() const
 {
     return ZMKCode(m_type);
 }
 
-QString Antecedent::symbol(Type type)
-{
-    switch (type) {
-        case A: return "A";
-        case B: return "B";
-        case C: return "C";
-        case D: return "D";
-        case E: return "E";
-        case F: return "F";
-        case G: return "G";
-        case H: return "H";
-        case I: return "I";
-        case J: return "J";
-        case K: return "K";
-        case L: return "L";
-        case M: return "M";
-        case N: return "N";
-        case O: return "O";
-        case P: return "P";
-        case Q: return "Q";
-        case R: return "R";
-        case S: return "S";
-        case T: return "T";
-        case U: return "U";
-        case V: return "V";
-        case W: return "W";
-        case X: return "X";
-        case Y: return "Y";
-        case Z: return "Z";
-        case N0: return "0";
-        case N1: return "1";
-        case N2: return "2";
-        case N3: return "3";
-        case N4: return "4";
-        case N5: return "5";
-        case N6: return "6";
-        case N7: return "7";
-        case N8: return "8";
-        case N9: return "9";
-        case Comma: return ",";
-        case Dot: return ".";
-        case Quote: return "'";
-        case Slash: return "/";
-        case LBrace: return "{";
-        case RBrace: return "}";
-        case LParen: return "(";
-        case RParen: return ")";
-        case Star: return "*";
-        case Colon: return ":";
-        case Dollar: return "$";
-        case Percent: return "%";
-        case Caret: return "^";
-        case Plus: return "+";
-        case Tilda: return "~";
-        case Exclamation: return "!";
-        case At: return "@";
-        case Hash: return "#";
-        case Pipe: return "|";
-        case Ampersand: return "&";
-        case Underscore: return "_";
-        case LBracket: return "[";
-        case RBracket: return "]";
-        case Semicolon: return ";";
-        case Grave: return "`";
-        case Equal: return "=";
-        case Backslash: return "\\";
-        case Minus: return "-";
-        case Space: return " ";
-    }
-    assert(false && "Should not happen");
-    return {};
+QStringView Antecedent::symbol(Type type)
+{
+    return isValidType(type) ? Symbols[type] : QStringView{};
 }
 
-QString Antecedent::ZMKCode(Type type)
-{
-    switch (type) {
-        case A: return "A";
-        case B: return "B";
-        case C: return "C";
-        case D: return "D";
-        case E: return "E";
-        case F: return "F";
-        case G: return "G";
-        case H: return "H";
-        case I: return "I";
-        case J: return "J";
-        case K: return "K";
-        case L: return "L";
-        case M: return "M";
-        case N: return "N";
-        case O: return "O";
-        case P: return "P";
-        case Q: return "Q";
-        case R: return "R";
-        case S: return "S";
-        case T: return "T";
-        case U: return "U";
-        case V: return "V";
-        case W: return "W";
-        case X: return "X";
-        case Y: return "Y";
-        case Z: return "Z";
-        case N0: return "N0";
-        case N1: return "N1";
-        case N2: return "N2";
-        case N3: return "N3";
-        case N4: return "N4";
-        case N5: return "N5";
-        case N6: return "N6";
-        case N7: return "N7";
-        case N8: return "N8";
-        case N9: return "N9";
-        case Comma: return "COMMA";
-        case Dot: return "DOT";
-        case Quote: return "SQT";
-        case Slash: return "FSLH";
-        case LBrace: return "LBRC";
-        case RBrace: return "RBRC";
-        case LParen: return "LPAR";
-        case RParen: return "RPAR";
-        case Star: return "STAR";
-        case Colon: return "COLON";
-        case Dollar: return "DLLR";
-        case Percent: return "PRCNT";
-        case Caret: return "CARET";
-        case Plus: return "PLUS";
-        case Tilda: return "TILDE";
-        case Exclamation: return "EXCL";
-        case At: return "AT";
-        case Hash: return "HASH";
-        case Pipe: return "PIPE";
-        case Ampersand: return "AMPS";
-        case Underscore: return "UNDER";
-        case LBracket: return "LBKT";
-        case RBracket: return "RBKT";
-        case Semicolon: return "SEMI";
-        case Grave: return "GRAVE";
-        case Equal: return "EQUAL";
-        case Backslash: return "BSLH";
-        case Minus: return "MINUS";
-        case Space: return "SPACE";
-    }
-    assert(false && "Should not happen");
-    return {};
+QStringView Antecedent::ZMKCode(Type type)
+{
+    return isValidType(type) ? ZmkCodes[type] : QStringView{};
 }
 
-QString Antecedent::QMKCode(Type type)
-{
-    switch (type) {
-        case A: return "KC_A";
-        case B: return "KC_B";
-        case C: return "KC_C";
-        case D: return "KC_D";
-        case E: return "KC_E";
-        case F: return "KC_F";
-        case G: return "KC_G";
-        case H: return "KC_H";
-        case I: return "KC_I";
-        case J: return "KC_J";
-        case K: return "KC_K";
-        case L: return "KC_L";
-        case M: return "KC_M";
-        case N: return "KC_N";
-        case O: return "KC_O";
-        case P: return "KC_P";
-        case Q: return "KC_Q";
-        case R: return "KC_R";
-        case S: return "KC_S";
-        case T: return "KC_T";
-        case U: return "KC_U";
-        case V: return "KC_V";
-        case W: return "KC_W";
-        case X: return "KC_X";
-        case Y: return "KC_Y";
-        case Z: return "KC_Z";
-        case N0: return "KC_0";
-        case N1: return "KC_1";
-        case N2: return "KC_2";
-        case N3: return "KC_3";
-        case N4: return "KC_4";
-        case N5: return "KC_5";
-        case N6: return "KC_6";
-        case N7: return "KC_7";
-        case N8: return "KC_8";
-        case N9: return "KC_9";
-        case Comma: return "KC_COMM";
-        case Dot: return "KC_DOT";
-        case Quote: return "KC_QUOT";
-        case Slash: return "KC_SLSH";
-        case LBrace: return "KC_LCBR";
-        case RBrace: return "KC_RCBR";
-        case LParen: return "KC_LPRN";
-        case RParen: return "KC_RPRN";
-        case Star: return "KC_ASTR";
-        case Colon: return "KC_COLN";
-        case Dollar: return "KC_DLR";
-        case Percent: return "KC_PERC";
-        case Caret: return "KC_CIRC";
-        case Plus: return "KC_PLUS";
-        case Tilda: return "KC_TILD";
-        case Exclamation: return "KC_EXLM";
-        case At: return "KC_AT";
-        case Hash: return "KC_HASH";
-        case Pipe: return "KC_PIPE";
-        case Ampersand: return "KC_AMPR";
-        case Underscore: return "KC_UNDS";
-        case LBracket: return "KC_LBRC";
-        case RBracket: return "KC_RBRC";
-        case Semicolon: return "KC_SCLN";
-        case Grave: return "KC_GRV";
-        case Equal: return "KC_EQL";
-        case Backslash: return "KC_BSLS";
-        case Minus: return "KC_MINS";
-        case Space: return "KC_SPC";
-    }
-    assert(false && "Should not happen");
-    return {};
+int Antecedent::typeOfZMKCode(QStringView code)
+{
+    auto const it = std::find(std::begin(ZmkCodes), std::end(ZmkCodes), code);
+    return it == std::end(ZmkCodes) ? -1 : static_cast<int>(it - std::begin(ZmkCodes));
 }
 
-int Antecedent::rowOf(const SchemaItem *me) const
+QStringView Antecedent::QMKCode(Type type)
 {
-    auto const it = std::find_if(m_layers.cbegin(), m_layers.cend(),
-                        [me](std::unique_ptr<Layer> const &item) {
-                            return item.get() == me;
-                        });
-    if (it != m_layers.cend())
-        return std::distance(m_layers.cbegin(), it);
-
-    Q_ASSERT(false && "Should not happen");
-    return -1;
+    return isValidType(type) ? QmkCodes[type] : QStringView{};
 }
 
 Layer::Layer(LayerType type, SchemaItem *parent)
-    : SchemaItem{parent},
+    : SchemaItem{parent, static_cast<int>(type)},
       m_type{type},
+      m_morphCount{morphCount(type)},
       m_morphs{}
 {
-    if (type == LayerType::Base || type == LayerType::Mouse || type == LayerType::Navigation || type == LayerType::Media) {
-        m_morphs.push_back(std::make_unique<Morph>(MorphType::NorthEast, Mode::Text, this));
-        m_morphs.push_back(std::make_unique<Morph>(MorphType::East, Mode::Text, this));
-        m_morphs.push_back(std::make_unique<Morph>(MorphType::SouthEast, Mode::Text, this));
-    }
-    if (type == LayerType::Base || type == LayerType::Symbol || type == LayerType::Number || type == LayerType::Function) {
-        m_morphs.push_back(std::make_unique<Morph>(MorphType::NorthWest, Mode::Text, this));
-        m_morphs.push_back(std::make_unique<Morph>(MorphType::West, Mode::Text, this));
-        m_morphs.push_back(std::make_unique<Morph>(MorphType::SouthWest, Mode::Text, this));
-    }
+
+}
+
+Layer::~Layer()
+{
+    for (auto *m : m_morphs)
+        if (m)
+            std::destroy_at(m);
+}
+
+int Layer::morphCount(LayerType type)
+{
+    return type == LayerType::Base ? 6 : 3;
+}
+
+SchemaItemSlots<Morph> Layer::morphs() const
+{
+    return {m_morphs, m_morphCount};
 }
 
 bool Layer::fromJson(const QJsonObject &json)
 {
-    m_type = static_cast<LayerType>(json["type"].toInt());
     int i{0};
     auto const morphs = json["morphs"].toArray();
     for (auto const &m: morphs) {
-        m_morphs[i]->fromJson(m.toObject());
+        if (i == m_morphCount)
+            break;
+        auto const morph = m.toObject();
+        if (m_morphs[i] || !isBlank(morph))
+            materialize(i)->fromJson(morph);
         ++i;
     }
     return true;
@@ -774,8 +1183,8 @@ bool Layer::fromJson(const QJsonObject &json)
 QJsonObject Layer::toJson() const
 {
     QJsonArray morphs;
-    for (auto const &m : m_morphs) {
-        morphs << m->toJson();
+    for (int i = 0; i < m_morphCount; ++i) {
+        morphs << (m_morphs[i] ? m_morphs[i]->toJson() : blankMorphJson(morphTypeAt(i)));
     }
     QJsonObject layer;
     layer["type"] = int(m_type);
@@ -783,58 +1192,61 @@ QJsonObject Layer::toJson() const
     return layer;
 }
 
+bool Layer::fromSparseJson(const QJsonObject &json)
+{
+    for (int i = 0; i < m_morphCount; ++i) {
+        auto const morph = json[Morph::key(morphTypeAt(i))];
+        if (morph.isObject())
+            materialize(i)->fromSparseJson(morph.toObject());
+    }
+    return true;
+}
+
+QJsonObject Layer::toSparseJson() const
+{
+    QJsonObject layer;
+    for (int i = 0; i < m_morphCount; ++i) {
+        if (!m_morphs[i])
+            continue;
+        auto const morph = m_morphs[i]->toSparseJson();
+        if (!morph.isEmpty())
+            layer[Morph::key(morphTypeAt(i))] = morph;
+    }
+    return layer;
+}
+
 void Layer::clear()
 {
-    std::for_each(m_morphs.cbegin(), m_morphs.cend(),
-                  [](std::unique_ptr<Morph> const &m) { m->clear(); });
+    for (auto *&m : m_morphs) {
+        if (!m)
+            continue;
+        m->clear();
+        std::destroy_at(m);
+        m = nullptr;
+    }
 }
 
 bool Layer::isEmpty(MorphType morphType) const
 {
-    int idx = int(morphType);
-    if (m_type == LayerType::Symbol
-      || m_type == LayerType::Number
-      || m_type == LayerType::Function)
-    {
-        idx -= 3;
-    }
-    return m_morphs[idx]->isEmpty();
+    auto const *m = m_morphs[indexOf(morphType)];
+    return !m || m->isEmpty();
 }
 
 bool Layer::isEmpty(MorphType morphType, ModType modType) const
 {
-    int idx = int(morphType);
-    if (m_type == LayerType::Symbol
-      || m_type == LayerType::Number
-      || m_type == LayerType::Function)
-    {
-        idx -= 3;
-    }
-    return m_morphs[idx]->isEmpty(modType);
+    auto const *m = m_morphs[indexOf(morphType)];
+    return !m || m->isEmpty(modType);
 }
 
 Morph *Layer::getMorph(MorphType morphType) const
 {
-    int idx = int(morphType);
-    if (m_type == LayerType::Symbol
-      || m_type == LayerType::Number
-      || m_type == LayerType::Function)
-    {
-        idx -= 3;
-    }
-    return m_morphs[idx].get();
+    return m_morphs[indexOf(morphType)];
 }
 
 Mod *Layer::getMod(MorphType morphType, ModType modType) const
 {
-    int idx = int(morphType);
-    if (m_type == LayerType::Symbol
-      || m_type == LayerType::Number
-      || m_type == LayerType::Function)
-    {
-        idx -= 3;
-    }
-    return m_morphs[idx]->getMod(modType);
+    auto const *m = m_morphs[indexOf(morphType)];
+    return m ? m->getMod(modType) : nullptr;
 }
 
 SchemaItem::Kind Layer::kind() const
@@ -844,13 +1256,13 @@ SchemaItem::Kind Layer::kind() const
 
 SchemaItem *Layer::child(int row)
 {
-    return m_morphs[row].get();
+    return materialize(row);
 }
 
 int Layer::childCount(int schemaType) const
 {
     Q_UNUSED(schemaType);
-    return int(m_morphs.size());
+    return m_morphCount;
 }
 
 int Layer::itemType() const
@@ -858,6 +1270,11 @@ int Layer::itemType() const
     return int(m_type);
 }
 
+QLatin1StringView Layer::key(LayerType type)
+{
+    return LayerKeys[static_cast<int>(type)];
+}
+
 QString Layer::name() const
 {
     switch (m_type) {
@@ -874,58 +1291,93 @@ QString Layer::name() const
     return {};
 }
 
-bool Layer::isChanged() const
+void Layer::clearChanged()
 {
-    for (auto const &m : m_morphs)
-        if (m->isChanged())
-            return true;
+    if (!isChanged())
+        return;
 
-    return false;
+    for (auto &m : morphs())
+        if (m.isChanged())
+            m.clearChanged();
 }
 
-void Layer::clearChanged()
+int Layer::indexOf(LayerType type, MorphType morphType)
 {
-    for (auto &m : m_morphs)
-        m->clearChanged();
+    int idx = int(morphType);
+    if (type == LayerType::Symbol
+      || type == LayerType::Number
+      || type == LayerType::Function)
+    {
+        idx -= 3;
+    }
+    return idx;
 }
 
-int Layer::rowOf(const SchemaItem *me) const
+int Layer::indexOf(MorphType morphType) const
 {
-    auto const it = std::find_if(m_morphs.cbegin(), m_morphs.cend(),
-                        [me](std::unique_ptr<Morph> const &item) {
-                            return item.get() == me;
-                        });
-    if (it != m_morphs.cend())
-        return std::distance(m_morphs.cbegin(), it);
+    return indexOf(m_type, morphType);
+}
 
-    Q_ASSERT(false && "Should not happen");
-    return -1;
+MorphType Layer::morphTypeAt(int row) const
+{
+    if (m_type == LayerType::Symbol
+      || m_type == LayerType::Number
+      || m_type == LayerType::Function)
+    {
+        row += 3;
+    }
+    return static_cast<MorphType>(row);
 }
 
-Morph::Morph(MorphType type, Mode mode, SchemaItem *parent)
-    : SchemaItem{parent},
+Morph *Layer::materialize(int row)
+{
+    if (!m_morphs[row])
+        m_morphs[row] = new (arena().allocate<Morph>(1)) Morph{morphTypeAt(row), Mode::Text, row, this};
+
+    return m_morphs[row];
+}
+
+Morph::Morph(MorphType type, Mode mode, int row, SchemaItem *parent)
+    : SchemaItem{parent, row},
       m_type{type},
       m_mode{mode},
       m_mods{},
-      m_value{},
-      m_changed{false}
+      m_value{}
+{
+
+}
+
+Morph::~Morph()
+{
+    std::destroy(m_mods.begin(), m_mods.end());
+}
+
+SchemaItemSpan<Mod> Morph::mods() const
 {
-    m_mods.push_back(std::make_unique<Mod>(ModType::Control, Mode::Text, this));
-    m_mods.push_back(std::make_unique<Mod>(ModType::Alt, Mode::Text, this));
-    m_mods.push_back(std::make_unique<Mod>(ModType::GUI, Mode::Text, this));
+    return m_mods;
 }
 
 bool Morph::fromJson(const QJsonObject &json)
 {
-    m_type = static_cast<MorphType>(json["type"].toInt());
-    m_mode = static_cast<Mode>(json["mode"].toInt());
+    auto const mode = json["mode"].toInt();
+    if (!isValidMode(mode))
+        return false;
+
+    m_mode = static_cast<Mode>(mode);
     m_value = json["value"].toString();
-    m_changed = false;
+    resetChanged();
+    updatePopulation();
 
     int i{0};
     auto const mods = json["mods"].toArray();
     for (auto const &m: mods) {
-        m_mods[i]->fromJson(m.toObject());
+        if (i == ModCount)
+            break;
+        auto const mod = m.toObject();
+        if (m_mods.size() || !isBlank(mod)) {
+            materializeMods();
+            m_mods[i].fromJson(mod);
+        }
         ++i;
     }
     return true;
@@ -934,8 +1386,8 @@ bool Morph::fromJson(const QJsonObject &json)
 QJsonObject Morph::toJson() const
 {
     QJsonArray mods;
-    for (auto const &m: m_mods) {
-        mods << m->toJson();
+    for (int i = 0; i < ModCount; ++i) {
+        mods << (m_mods.size() ? m_mods[i].toJson() : blankJson(i));
     }
     QJsonObject morph;
     morph["type"] = static_cast<int>(m_type);
@@ -945,13 +1397,50 @@ QJsonObject Morph::toJson() const
     return morph;
 }
 
+bool Morph::fromSparseJson(const QJsonObject &json)
+{
+    auto const mode = json["mode"].toInt();
+    if (!isValidMode(mode))
+        return false;
+
+    m_mode = static_cast<Mode>(mode);
+    m_value = json["value"].toString();
+    resetChanged();
+    updatePopulation();
+
+    for (int i = 0; i < ModCount; ++i) {
+        auto const mod = json[Mod::key(static_cast<ModType>(i))];
+        if (!mod.isObject())
+            continue;
+        materializeMods();
+        m_mods[i].fromSparseJson(mod.toObject());
+    }
+    return true;
+}
+
+QJsonObject Morph::toSparseJson() const
+{
+    QJsonObject morph;
+    if (m_mode != Mode::Text)
+        morph["mode"] = static_cast<int>(m_mode);
+    if (!m_value.isEmpty())
+        morph["value"] = m_value;
+    for (int i = 0; i < m_mods.size(); ++i) {
+        auto const mod = m_mods[i].toSparseJson();
+        if (!mod.isEmpty())
+            morph[Mod::key(static_cast<ModType>(i))] = mod;
+    }
+    return morph;
+}
+
 void Morph::clear()
 {
     m_mode = Mode::Text;
     m_value.clear();
-    m_changed = false;
-    std::for_each(m_mods.cbegin(), m_mods.cend(),
-                  [](std::unique_ptr<Mod> const &m) { m->clear(); });
+    resetChanged();
+    updatePopulation();
+    std::for_each(m_mods.begin(), m_mods.end(),
+                  [](Mod &m) { m.clear(); });
 }
 
 bool Morph::isEmpty() const
@@ -964,7 +1453,7 @@ bool Morph::isEmpty() const
 
 bool Morph::isEmpty(ModType modType) const
 {
-    return m_mods[static_cast<int>(modType)]->isEmpty();
+    return !m_mods.size() || m_mods[static_cast<int>(modType)].isEmpty();
 }
 
 bool Morph::isValid() const
@@ -977,12 +1466,12 @@ bool Morph::isValid() const
 
 Mod *Morph::getMod(ModType modType) const
 {
-    return m_mods[static_cast<int>(modType)].get();
+    return m_mods.size() ? &m_mods[static_cast<int>(modType)] : nullptr;
 }
 
-bool Morph::isSingleLettered(QString const &symbol) const
+bool Morph::isSingleLettered(QStringView symbol) const
 {
-    return m_mode == Mode::Text && m_value.length() == 2 && m_value.first(1).toLower() == symbol.toLower();
+    return m_mode == Mode::Text && m_value.length() == 2 && symbol.compare(m_value.first(1), Qt::CaseInsensitive) == 0;
 }
 
 SchemaItem::Kind Morph::kind() const
@@ -992,13 +1481,14 @@ SchemaItem::Kind Morph::kind() const
 
 SchemaItem *Morph::child(int row)
 {
-    return m_mods[row].get();
+    materializeMods();
+    return &m_mods[row];
 }
 
 int Morph::childCount(int schemaType) const
 {
     Q_UNUSED(schemaType)
-    return int(m_mods.size());
+    return ModCount;
 }
 
 int Morph::itemType() const
@@ -1006,6 +1496,11 @@ int Morph::itemType() const
     return static_cast<int>(m_type);
 }
 
+QLatin1StringView Morph::key(MorphType type)
+{
+    return MorphKeys[static_cast<int>(type)];
+}
+
 QString Morph::name() const
 {
     switch (m_type) {
@@ -1027,11 +1522,12 @@ QStringList Morph::modes() const
 
 bool Morph::setMode(int mode)
 {
-    if (m_mode == static_cast<Mode>(mode))
+    if (!isValidMode(mode) || m_mode == static_cast<Mode>(mode))
         return false;
 
     m_mode = static_cast<Mode>(mode);
-    m_changed = true;
+    setChanged();
+    updatePopulation();
     return true;
 }
 
@@ -1067,7 +1563,8 @@ bool Morph::setValue(const QString &value)
         return false;
 
     m_value = value;
-    m_changed = true;
+    setChanged();
+    updatePopulation();
     return true;
 }
 
@@ -1076,54 +1573,53 @@ int Morph::morphType() const
     return int(m_type);
 }
 
-bool Morph::isChanged() const
+void Morph::clearChanged()
 {
-    if (m_changed)
-        return true;
-
-    for (auto const &m : m_mods)
-        if (m->isChanged())
-            return true;
+    if (!isChanged())
+        return;
 
-    return false;
+    resetChanged();
+    for (auto &m : m_mods)
+        if (m.isChanged())
+            m.clearChanged();
 }
 
-void Morph::clearChanged()
+void Morph::materializeMods()
 {
-    m_changed = false;
-    for (auto &m : m_mods)
-        m->clearChanged();
+    if (m_mods.size())
+        return;
+
+    auto *mods = arena().allocate<Mod>(ModCount);
+    new (mods + 0) Mod{ModType::Control, Mode::Text, this};
+    new (mods + 1) Mod{ModType::Alt, Mode::Text, this};
+    new (mods + 2) Mod{ModType::GUI, Mode::Text, this};
+    m_mods = {mods, ModCount};
 }
 
-int Morph::rowOf(const SchemaItem *me) const
+void Morph::updatePopulation()
 {
-    auto const it = std::find_if(m_mods.cbegin(), m_mods.cend(),
-                        [me](std::unique_ptr<Mod> const &item) {
-                            return item.get() == me;
-                        });
-    if (it != m_mods.cend())
-        return std::distance(m_mods.cbegin(), it);
-
-    Q_ASSERT(false && "Should not happen");
-    return -1;
+    setPopulated(antecedentType(), static_cast<LayerType>(m_parent->itemType()), m_type, -1, !isEmpty());
 }
 
 Mod::Mod(ModType type, Mode mode, SchemaItem *parent)
-    : SchemaItem{parent},
+    : SchemaItem{parent, static_cast<int>(type)},
       m_type{type},
       m_mode{mode},
-      m_value{},
-      m_changed{false}
+      m_value{}
 {
 
 }
 
 bool Mod::fromJson(const QJsonObject &json)
 {
-    m_type = static_cast<ModType>(json["type"].toInt());
-    m_mode = static_cast<Mode>(json["mode"].toInt());
+    auto const mode = json["mode"].toInt();
+    if (!isValidMode(mode))
+        return false;
+
+    m_mode = static_cast<Mode>(mode);
     m_value = json["value"].toString();
-    m_changed = false;
+    resetChanged();
+    updatePopulation();
     return true;
 }
 
@@ -1136,11 +1632,35 @@ QJsonObject Mod::toJson() const
     return mod;
 }
 
+bool Mod::fromSparseJson(const QJsonObject &json)
+{
+    auto const mode = json["mode"].toInt();
+    if (!isValidMode(mode))
+        return false;
+
+    m_mode = static_cast<Mode>(mode);
+    m_value = json["value"].toString();
+    resetChanged();
+    updatePopulation();
+    return true;
+}
+
+QJsonObject Mod::toSparseJson() const
+{
+    QJsonObject mod;
+    if (m_mode != Mode::Text)
+        mod["mode"] = static_cast<int>(m_mode);
+    if (!m_value.isEmpty())
+        mod["value"] = m_value;
+    return mod;
+}
+
 void Mod::clear()
 {
     m_mode = Mode::Text;
     m_value.clear();
-    m_changed = false;
+    resetChanged();
+    updatePopulation();
 }
 
 bool Mod::isEmpty() const
@@ -1159,9 +1679,9 @@ bool Mod::isValid() const
     return m_value.size() != 1;
 }
 
-bool Mod::isSingleLettered(const QString &symbol) const
+bool Mod::isSingleLettered(QStringView symbol) const
 {
-    return m_mode == Mode::Text && m_value.length() == 2 && m_value.first(1).toLower() == symbol.toLower();
+    return m_mode == Mode::Text && m_value.length() == 2 && symbol.compare(m_value.first(1), Qt::CaseInsensitive) == 0;
 }
 
 SchemaItem::Kind Mod::kind() const
@@ -1185,6 +1705,11 @@ int Mod::itemType() const
     return static_cast<int>(m_type);
 }
 
+QLatin1StringView Mod::key(ModType type)
+{
+    return ModKeys[static_cast<int>(type)];
+}
+
 QString Mod::name() const
 {
     switch (m_type) {
@@ -1203,11 +1728,12 @@ QStringList Mod::modes() const
 
 bool Mod::setMode(int mode)
 {
-    if (m_mode == static_cast<Mode>(mode))
+    if (!isValidMode(mode) || m_mode == static_cast<Mode>(mode))
         return false;
 
     m_mode = static_cast<Mode>(mode);
-    m_changed = true;
+    setChanged();
+    updatePopulation();
     return true;
 }
 
@@ -1243,7 +1769,8 @@ bool Mod::setValue(const QString &value)
         return false;
 
     m_value = value;
-    m_changed = true;
+    setChanged();
+    updatePopulation();
     return true;
 }
 
@@ -1252,14 +1779,15 @@ int Mod::morphType() const
     return m_parent->morphType();
 }
 
-bool Mod::isChanged() const
+void Mod::clearChanged()
 {
-    return m_changed;
+    resetChanged();
 }
 
-void Mod::clearChanged()
+void Mod::updatePopulation()
 {
-    m_changed = false;
+    setPopulated(antecedentType(), static_cast<LayerType>(m_parent->parent()->itemType()),
+                 static_cast<MorphType>(m_parent->itemType()), static_cast<int>(m_type), !isEmpty());
 }
 
 Modifier Mod::pressedModifier() const
@@ -1294,8 +1822,3 @@ Modifier Mod::pressedModifier() const
     return NoModifier;
 }
 
-int Mod::rowOf(const SchemaItem *me) const
-{
-    assert(false && "Should not happen");
-    return -1;
-}
@@ -3,6 +3,11 @@
 
 #include <QString>
 #include <QJsonDocument>
+#include <QJsonObject>
+#include <QByteArrayView>
+#include <QtAlgorithms>
+#include "schemaarena.hpp"
+#include <memory>
 
 enum class LayerType {
     Base,
@@ -46,15 +51,114 @@ enum Modifier {
  };
 
 class Antecedent;
+class SchemaSnapshot;
+
+template <typename T>
+class SchemaItemSpan
+{
+public:
+    SchemaItemSpan() = default;
+    SchemaItemSpan(T *first, int size) : m_first{first}, m_size{size} {}
+
+    T *begin() const { return m_first; }
+    T *end() const { return m_first + m_size; }
+    int size() const { return m_size; }
+    T &operator[](int i) const { return m_first[i]; }
+
+private:
+    T *m_first{nullptr};
+    int m_size{0};
+};
+
+// Range over item slots that may be left unmaterialized; empty slots are skipped
+template <typename T>
+class SchemaItemSlots
+{
+public:
+    class Iterator
+    {
+    public:
+        Iterator(T *const *slot, T *const *end) : m_slot{slot}, m_end{end} { skip(); }
+
+        T &operator*() const { return **m_slot; }
+        Iterator &operator++() { ++m_slot; skip(); return *this; }
+        bool operator!=(Iterator const &other) const { return m_slot != other.m_slot; }
+
+    private:
+        void skip() { while (m_slot != m_end && !*m_slot) ++m_slot; }
+
+    private:
+        T *const *m_slot;
+        T *const *m_end;
+    };
+
+public:
+    SchemaItemSlots(T *const *first, int size) : m_first{first}, m_size{size} {}
+
+    Iterator begin() const { return {m_first, m_first + m_size}; }
+    Iterator end() const { return {m_first + m_size, m_first + m_size}; }
+
+private:
+    T *const *m_first;
+    int m_size;
+};
+
+// Antecedent types, iterated in ascending order
+class AntecedentSet
+{
+public:
+    static constexpr int WordCount = 2;
+
+    class Iterator
+    {
+    public:
+        Iterator(quint64 const *words, int word)
+            : m_words{words}, m_word{word}, m_bits{word < WordCount ? words[word] : 0}
+        { advance(); }
+
+        int operator*() const { return m_word * 64 + int(qCountTrailingZeroBits(m_bits)); }
+        Iterator &operator++() { m_bits &= m_bits - 1; advance(); return *this; }
+        bool operator!=(Iterator const &other) const { return m_word != other.m_word || m_bits != other.m_bits; }
+
+    private:
+        void advance()
+        {
+            while (!m_bits && m_word < WordCount - 1)
+                m_bits = m_words[++m_word];
+            if (!m_bits)
+                m_word = WordCount;
+        }
+
+    private:
+        quint64 const *m_words;
+        int m_word;
+        quint64 m_bits;
+    };
+
+public:
+    constexpr void insert(int type) { m_words[type / 64] |= quint64{1} << (type % 64); }
+    constexpr void remove(int type) { m_words[type / 64] &= ~(quint64{1} << (type % 64)); }
+    constexpr bool contains(int type) const { return m_words[type / 64] & (quint64{1} << (type % 64)); }
+    constexpr bool isEmpty() const { return !(m_words[0] | m_words[1]); }
+
+    Iterator begin() const { return {m_words, 0}; }
+    Iterator end() const { return {m_words, WordCount}; }
+
+private:
+    quint64 m_words[WordCount]{};
+};
 
 class SchemaItem
 {
 public:
     enum class Kind {Schema, Antecedent, Layer, Morph, Mod};
 public:
-    explicit SchemaItem(SchemaItem *parent = nullptr);
+    explicit SchemaItem(SchemaItem *parent = nullptr, int row = 0);
     virtual ~SchemaItem() = default;
 
+    SchemaItem(SchemaItem const &) = delete;
+    SchemaItem &operator=(SchemaItem const &) = delete;
+
     virtual Kind kind() const = 0;
     virtual SchemaItem *child(int row) = 0;
     virtual int childCount(int schemaType) const = 0;
@@ -75,7 +179,7 @@ public:
     virtual bool isRight() const;
     virtual int morphType() const;
 
-    virtual bool isChanged() const = 0;
+    bool isChanged() const;
     virtual void clearChanged() = 0;
 
     virtual int antecedentType() const;
@@ -85,10 +189,17 @@ public:
     virtual Modifier pressedModifier() const;
 
 protected:
-    virtual int rowOf(SchemaItem const *me) const = 0;
+    void setChanged();
+    void resetChanged();
+    virtual SchemaArena &arena();
+    virtual void setPopulated(int antecedentType, LayerType layerType, MorphType morphType, int modType, bool populated);
+    virtual void invalidate();
 
 protected:
     SchemaItem *m_parent;
+    int m_row;
+    bool m_changed;
+    int m_changedBelow;
 };
 
 class Schema : public SchemaItem
@@ -97,9 +208,14 @@ public:
     friend class ZmkCodeGenerator;
 public:
     enum Type {Flat, Deep};
+    static constexpr int AntecedentCount = 65;
+    // Layer x morph x (the morph itself and each of its mods)
+    static constexpr int BucketCount = 7 * 6 * 4;
+    // Format written by toJson(); format 1 is still read and can be written on request
+    static constexpr int Format = 2;
 public:
     Schema(Type type, SchemaItem *parent = nullptr);
-    ~Schema() override = default;
+    ~Schema() override;
 
     bool isNew() const;
     bool setFilePath(QString filePath);
@@ -107,7 +223,17 @@ public:
     QString suggestedFileName() const;
 
     bool fromJson(QJsonDocument const &jsonDoc);
-    QJsonDocument toJson();
+    QJsonDocument toJson(int format = Format);
+    // Same bytes as toJson().toJson(), reusing fragments of unchanged antecedents
+    QByteArray toJsonData();
+    // Cached until the next change, so repeated calls are cheap. Filling the
+    // caches is not thread-safe: call it only on the thread editing the
+    // schema (the GUI thread) and hand the snapshot to workers
+    SchemaSnapshot snapshot() const;
+    bool fromSnapshot(SchemaSnapshot const &snapshot);
+    static bool isBinary(QByteArrayView data);
+    bool fromBinary(QByteArrayView data);
+    QByteArray toBinary();
     void clear();
 
     bool setName(QString const &name);
@@ -122,6 +248,9 @@ public:
     bool isEmpty(LayerType layerType, MorphType morphType) const;
     bool isEmpty(LayerType layerType, MorphType morphType, ModType modType) const;
 
+    AntecedentSet const &populated(LayerType layerType, MorphType morphType) const;
+    AntecedentSet const &populated(LayerType layerType, MorphType morphType, ModType modType) const;
+
 public: // SchemaItem interface
     SchemaItem::Kind kind() const override;
     SchemaItem *child(int row) override;
@@ -131,13 +260,18 @@ public: // SchemaItem interface
 
     bool isRight() const override;
 
-    bool isChanged() const override;
+    void markChanged();
     void clearChanged() override;
 
     int antecedentType() const override;
 
 protected:
-    int rowOf(SchemaItem const *me) const override;
+    SchemaArena &arena() override;
+    void setPopulated(int antecedentType, LayerType layerType, MorphType morphType, int modType, bool populated) override;
+    void invalidate() override;
+
+private:
+    static int bucket(LayerType layerType, MorphType morphType, int modType);
 
 private:
     QString m_filePath;
@@ -145,8 +279,11 @@ private:
     QString m_version;
     Type m_type;
     QString m_prefix;
-    std::vector<std::unique_ptr<Antecedent>> m_antecedents;
-    bool m_changed;
+    SchemaArena m_arena;
+    SchemaArena::Mark m_cells;
+    SchemaItemSpan<Antecedent> m_antecedents;
+    AntecedentSet m_population[BucketCount];
+    mutable std::unique_ptr<SchemaSnapshot> m_snapshot;
 };
 
 class Layer;
@@ -168,12 +305,18 @@ public:
         Ampersand, Underscore,
         LBracket, RBracket, Semicolon, Grave, Equal, Backslash, Minus, Space
     };
+    static constexpr int LayerCount = 7;
 public:
-    explicit Antecedent(Type type, SchemaItem *parent);
-    ~Antecedent() override = default;
+    explicit Antecedent(Type type, SchemaItem *parent, Layer *base);
+    ~Antecedent() override;
+
+    SchemaItemSlots<Layer> layers() const;
 
     bool fromJson(QJsonObject const &json);
     QJsonObject toJson(int schemaType) const;
+    bool fromSparseJson(QJsonObject const &json);
+    QJsonObject toSparseJson(int schemaType) const;
+    QByteArray const &jsonFragment(int schemaType) const;
     void clear();
 
     Type type() const;
@@ -193,42 +336,56 @@ public: // SchemaItem interface
 
     bool isRight() const override;
 
-    bool isChanged() const override;
     void clearChanged() override;
 
     int antecedentType() const override;
     bool setAntecedentNote(QString const &note) override;
     QString antecedentNote() const override;
 
-    QString symbol() const;
-    QString zmkCode() const;
+    QStringView symbol() const;
+    QStringView zmkCode() const;
 
 public:
-    static QString symbol(Type type);
-    static QString ZMKCode(Type type);
-    static QString QMKCode(Type type);
+    static QStringView symbol(Type type);
+    static QStringView ZMKCode(Type type);
+    static int typeOfZMKCode(QStringView code);
+    static QStringView QMKCode(Type type);
 
 protected:
-    int rowOf(SchemaItem const *me) const override;
+    void invalidate() override;
+
+private:
+    Layer *materialize(int row);
+
 private:
     Type m_type;
-    std::vector<std::unique_ptr<Layer>> m_layers;
+    Layer *m_layers[LayerCount];
     QString m_note;
-    bool m_changed;
+    mutable QJsonObject m_json;
+    mutable int m_jsonSchemaType;
+    mutable QByteArray m_fragment;
+    mutable int m_fragmentSchemaType;
 };
 
 class Layer : public SchemaItem
 {
 public:
     friend class ZmkCodeGenerator;
-public:
-
+    static constexpr int MaxMorphCount = 6;
 public:
     explicit Layer(LayerType type, SchemaItem *parent);
-    ~Layer() override = default;
+    ~Layer() override;
+
+    static int morphCount(LayerType type);
+    static int indexOf(LayerType type, MorphType morphType);
+    static QLatin1StringView key(LayerType type);
+
+    SchemaItemSlots<Morph> morphs() const;
 
     bool fromJson(QJsonObject const &json);
     QJsonObject toJson() const;
+    bool fromSparseJson(QJsonObject const &json);
+    QJsonObject toSparseJson() const;
     void clear();
 
     bool isEmpty(MorphType morphType) const;
@@ -244,28 +401,38 @@ public: // SchemaItem interface
     int itemType() const override;
     QString name() const override;
 
-    bool isChanged() const override;
     void clearChanged() override;
 
-protected:
-    int rowOf(SchemaItem const *me) const override;
+    int indexOf(MorphType morphType) const;
+    MorphType morphTypeAt(int row) const;
+
+private:
+    Morph *materialize(int row);
 
 private:
     LayerType m_type;
-    std::vector<std::unique_ptr<Morph>> m_morphs;
+    int m_morphCount;
+    Morph *m_morphs[MaxMorphCount];
 };
 
 class Morph : public SchemaItem
 {
 public:
     friend class ZmkCodeGenerator;
-
 public:
-    explicit Morph(MorphType type, Mode mode, SchemaItem *parent);
-    ~Morph() override = default;
+    static constexpr int ModCount = 3;
+public:
+    explicit Morph(MorphType type, Mode mode, int row, SchemaItem *parent);
+    ~Morph() override;
+
+    static QLatin1StringView key(MorphType type);
+
+    SchemaItemSpan<Mod> mods() const;
 
     bool fromJson(QJsonObject const &json);
     QJsonObject toJson() const;
+    bool fromSparseJson(QJsonObject const &json);
+    QJsonObject toSparseJson() const;
     void clear();
 
     bool isEmpty() const;
@@ -274,7 +441,7 @@ public:
 
     Mod *getMod(ModType modType) const;
 
-    bool isSingleLettered(const QString &symbol) const;
+    bool isSingleLettered(QStringView symbol) const;
 
 public: // SchemaItem interface
     SchemaItem::Kind kind() const override;
@@ -292,18 +459,17 @@ public: // SchemaItem interface
 
     int morphType() const override;
 
-    bool isChanged() const override;
     void clearChanged() override;
 
-protected:
-    int rowOf(SchemaItem const *me) const override;
+private:
+    void materializeMods();
+    void updatePopulation();
 
 private:
     MorphType m_type;
     Mode m_mode;
-    std::vector<std::unique_ptr<Mod>> m_mods;
+    SchemaItemSpan<Mod> m_mods;
     QString m_value;
-    bool m_changed;
 };
 
 class Mod : public SchemaItem
@@ -315,14 +481,18 @@ public:
     explicit Mod(ModType type, Mode mode, SchemaItem *parent);
     ~Mod() override = default;
 
+    static QLatin1StringView key(ModType type);
+
     bool fromJson(QJsonObject const &json);
     QJsonObject toJson() const;
+    bool fromSparseJson(QJsonObject const &json);
+    QJsonObject toSparseJson() const;
     void clear();
 
     bool isEmpty() const;
     bool isValid() const;
 
-    bool isSingleLettered(QString const &symbol) const;
+    bool isSingleLettered(QStringView symbol) const;
 
 public: // SchemaItem interface
     SchemaItem::Kind kind() const override;
@@ -340,19 +510,17 @@ public: // SchemaItem interface
 
     int morphType() const override;
 
-    bool isChanged() const override;
     void clearChanged() override;
 
      Modifier pressedModifier() const override;
 
-protected:
-    int rowOf(SchemaItem const *me) const override;
+private:
+    void updatePopulation();
 
 private:
     ModType m_type;
     Mode m_mode;
     QString m_value;
-    bool m_changed;
 };
 
 #endif // SCHEMA_HPP
@@ -0,0 +1,108 @@
+#include "schemaarena.hpp"
+#include <new>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+
+namespace {
+
+constexpr std::size_t HeaderSize = (sizeof(std::size_t) * 3 + alignof(std::max_align_t) - 1)
+        & ~(alignof(std::max_align_t) - 1);
+
+}
+
+SchemaArena::~SchemaArena()
+{
+    release();
+}
+
+void SchemaArena::reserve(std::size_t size)
+{
+    if (m_head && m_head->size - m_head->used >= size)
+        return;
+
+    addBlock(size);
+}
+
+void *SchemaArena::allocate(std::size_t size, std::size_t alignment)
+{
+    assert(alignment <= alignof(std::max_align_t) && "Unsupported alignment");
+
+    auto const place = [size, alignment](Block *block) -> void* {
+        auto const base = reinterpret_cast<std::uintptr_t>(data(block));
+        auto const offset = ((base + block->used + alignment - 1) & ~(alignment - 1)) - base;
+        if (offset + size > block->size)
+            return nullptr;
+
+        block->used = offset + size;
+        return data(block) + offset;
+    };
+
+    if (m_head) {
+        if (auto *p = place(m_head))
+            return p;
+    }
+
+    return place(addBlock(std::max(size + alignment, DefaultBlockSize)));
+}
+
+void SchemaArena::release()
+{
+    while (m_head) {
+        auto *next = m_head->next;
+        ::operator delete(m_head);
+        m_head = next;
+    }
+}
+
+SchemaArena::Mark SchemaArena::mark() const
+{
+    return {m_head, m_head ? m_head->used : 0};
+}
+
+void SchemaArena::rewind(const Mark &mark)
+{
+    while (m_head && m_head != mark.block) {
+        auto *next = m_head->next;
+        ::operator delete(m_head);
+        m_head = next;
+    }
+
+    if (m_head)
+        m_head->used = mark.used;
+}
+
+std::size_t SchemaArena::blockCount() const
+{
+    std::size_t count{0};
+    for (auto *b = m_head; b; b = b->next)
+        ++count;
+
+    return count;
+}
+
+std::size_t SchemaArena::bytesUsed() const
+{
+    std::size_t used{0};
+    for (auto *b = m_head; b; b = b->next)
+        used += b->used;
+
+    return used;
+}
+
+SchemaArena::Block *SchemaArena::addBlock(std::size_t size)
+{
+    static_assert(sizeof(Block) <= HeaderSize);
+
+    auto *block = static_cast<Block*>(::operator new(HeaderSize + size));
+    block->next = m_head;
+    block->size = size;
+    block->used = 0;
+    m_head = block;
+    return block;
+}
+
+char *SchemaArena::data(Block *block)
+{
+    return reinterpret_cast<char*>(block) + HeaderSize;
+}
@@ -0,0 +1,62 @@
+#ifndef SCHEMAARENA_HPP
+#define SCHEMAARENA_HPP
+
+#include <cstddef>
+
+// Bump allocator backing the Schema item tree. Memory is handed out in
+// contiguous runs and only returned when the arena is released; the items
+// themselves are destroyed by their owners.
+class SchemaArena
+{
+public:
+    static constexpr std::size_t DefaultBlockSize = 16 * 1024;
+
+    struct Mark {
+        void *block;
+        std::size_t used;
+    };
+
+public:
+    SchemaArena() = default;
+    ~SchemaArena();
+
+    SchemaArena(SchemaArena const &) = delete;
+    SchemaArena &operator=(SchemaArena const &) = delete;
+
+    void reserve(std::size_t size);
+    void *allocate(std::size_t size, std::size_t alignment);
+    void release();
+
+    Mark mark() const;
+    void rewind(Mark const &mark);
+
+    template <typename T>
+    T *allocate(std::size_t count)
+    {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    template <typename T>
+    static constexpr std::size_t footprint(std::size_t count)
+    {
+        return sizeof(T) * count + alignof(T);
+    }
+
+    std::size_t blockCount() const;
+    std::size_t bytesUsed() const;
+
+private:
+    struct Block {
+        Block *next;
+        std::size_t size;
+        std::size_t used;
+    };
+
+    Block *addBlock(std::size_t size);
+    static char *data(Block *block);
+
+private:
+    Block *m_head{nullptr};
+};
+
+#endif // SCHEMAARENA_HPP
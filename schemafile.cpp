@@ -0,0 +1,90 @@
+#include "schemafile.hpp"
+#include "schema.hpp"
+#include "schemareader.hpp"
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QSaveFile>
+
+namespace {
+
+void setError(QString *errorString, QString const &error)
+{
+    if (errorString)
+        *errorString = error;
+}
+
+bool loadJson(QByteArrayView data, Schema &schema, QString *errorString)
+{
+    if (SchemaReader{}.read(data, schema))
+        return true;
+
+    QJsonParseError error;
+    auto const json = QJsonDocument::fromJson(data.toByteArray(), &error);
+    if (error.error != QJsonParseError::NoError) {
+        setError(errorString, QString{"Failed to parse document: %1"}.arg(error.errorString()));
+        return false;
+    }
+    if (!schema.fromJson(json)) {
+        setError(errorString, "Not a schema document");
+        return false;
+    }
+    return true;
+}
+
+}
+
+bool SchemaFile::isBinary(const QString &filePath)
+{
+    return QFileInfo{filePath}.suffix().compare(BinarySuffix, Qt::CaseInsensitive) == 0;
+}
+
+bool SchemaFile::load(const QString &filePath, Schema &schema, QString *errorString)
+{
+    QFile file{filePath};
+    if (!file.open(QIODevice::ReadOnly)) {
+        setError(errorString, file.errorString());
+        return false;
+    }
+
+    // Map the file when possible; binary schemas are then read in place
+    QByteArray buffer;
+    QByteArrayView data;
+    if (auto const *mapped = file.map(0, file.size())) {
+        data = QByteArrayView{mapped, file.size()};
+    } else {
+        buffer = file.readAll();
+        data = buffer;
+    }
+
+    if (Schema::isBinary(data)) {
+        if (!schema.fromBinary(data)) {
+            setError(errorString, "Corrupt binary schema");
+            return false;
+        }
+    } else if (!loadJson(data, schema, errorString)) {
+        return false;
+    }
+
+    schema.setFilePath(filePath);
+    return true;
+}
+
+bool SchemaFile::save(const QString &filePath, Schema &schema, QString *errorString)
+{
+    // QSaveFile only replaces the target once everything has been written
+    bool const binary = isBinary(filePath);
+    QSaveFile file{filePath};
+    if (!file.open(binary ? QIODevice::WriteOnly : QIODevice::WriteOnly|QIODevice::Text)) {
+        setError(errorString, file.errorString());
+        return false;
+    }
+
+    auto const data = binary ? schema.toBinary() : schema.toJsonData();
+    if (file.write(data) != data.size() || !file.commit()) {
+        setError(errorString, file.errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef SCHEMAFILE_HPP
+#define SCHEMAFILE_HPP
+
+#include <QString>
+
+class Schema;
+
+// Loads and saves schemas without any GUI. Files ending in .amconfb use the
+// binary format, everything else is written as JSON. Loading detects the
+// format from the content.
+class SchemaFile
+{
+public:
+    static constexpr char const *BinarySuffix = "amconfb";
+
+public:
+    static bool isBinary(QString const &filePath);
+
+    static bool load(QString const &filePath, Schema &schema, QString *errorString = nullptr);
+    static bool save(QString const &filePath, Schema &schema, QString *errorString = nullptr);
+};
+
+#endif // SCHEMAFILE_HPP
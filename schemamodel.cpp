@@ -19,6 +19,18 @@ void SchemaModel::afterSchemaChange()
     endResetModel();
 }
 
+void SchemaModel::setSchema(SchemaItem *schema)
+{
+    m_schema = schema;
+}
+
+void SchemaModel::changesCleared()
+{
+    int const rows = rowCount();
+    if (rows > 0)
+        emit dataChanged(index(0, NameColumn, {}), index(rows - 1, NameColumn, {}), {Qt::FontRole});
+}
+
 QModelIndex SchemaModel::index(int row, int column, const QModelIndex &parent) const
 {
     if (parent.isValid() && parent.column() != 0)
@@ -80,12 +92,15 @@ bool SchemaModel::setData(const QModelIndex &index, const QVariant &value, int r
             }
             break;
         case Note:
-            item->setAntecedentNote(value.toString());
+            result = item->setAntecedentNote(value.toString());
             break;
     }
 
-    if (result)
+    if (result) {
         emit dataChanged(index, index, {Qt::DisplayRole, Qt::EditRole});
+        for (auto p = index.parent(); p.isValid(); p = p.parent())
+            emit dataChanged(p, p, {Qt::FontRole});
+    }
     return result;
 }
 
@@ -117,6 +132,7 @@ QVariant SchemaModel::data(const QModelIndex &index, int role) const
             if (item->kind() == SchemaItem::Kind::Antecedent) {
                 QFont f;
                 f.setPointSize(16);
+                f.setBold(item->isChanged());
                 return f;
             } else if (item->kind() == SchemaItem::Kind::Layer) {
                 QFont f;
@@ -30,6 +30,8 @@ public:
 
     void beforeSchemaChange();
     void afterSchemaChange();
+    void setSchema(SchemaItem *schema);
+    void changesCleared();
 
 public: // QAbstractItemModel interface
     QModelIndex index(int row, int column, const QModelIndex &parent) const override;
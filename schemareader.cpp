@@ -0,0 +1,433 @@
+#include "schemareader.hpp"
+#include "schema.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+// Index of the format 2 identifier matching key, or -1
+template <typename Type, int Count>
+int indexOfKey(QByteArrayView key, QLatin1StringView (*keyOf)(Type))
+{
+    for (int i = 0; i < Count; ++i) {
+        auto const k = keyOf(static_cast<Type>(i));
+        if (key == QByteArrayView{k.data(), k.size()})
+            return i;
+    }
+    return -1;
+}
+
+bool isValidMode(int mode)
+{
+    return mode >= static_cast<int>(Mode::Text) && mode <= static_cast<int>(Mode::SchemaName);
+}
+
+}
+
+template <typename F>
+bool SchemaReader::readObject(F onKey)
+{
+    if (!consume('{'))
+        return fail("Expected object");
+    if (consume('}'))
+        return true;
+
+    do {
+        QByteArrayView key;
+        if (!readKey(key))
+            return false;
+        if (!consume(':'))
+            return fail("Expected ':'");
+        if (!onKey(key))
+            return false;
+    } while (consume(','));
+
+    return consume('}') || fail("Expected '}'");
+}
+
+template <typename F>
+bool SchemaReader::readArray(F onElement)
+{
+    if (!consume('['))
+        return fail("Expected array");
+    if (consume(']'))
+        return true;
+
+    int index{0};
+    do {
+        if (!onElement(index++))
+            return false;
+    } while (consume(','));
+
+    return consume(']') || fail("Expected ']'");
+}
+
+bool SchemaReader::read(QByteArrayView data, Schema &schema)
+{
+    m_begin = data.begin();
+    m_pos = data.begin();
+    m_end = data.end();
+    m_error.clear();
+
+    schema.clear();
+
+    int format{1};
+    int type{Schema::Flat};
+    QString text;
+    bool const ok = readObject([&](QByteArrayView key) {
+        if (key == "format")
+            return readInt(format);
+        if (key == "type")
+            return readInt(type);
+        if (key == "antecedents")
+            return readAntecedents(schema);
+        if (key == "name" || key == "version" || key == "prefix") {
+            if (!readString(text))
+                return false;
+            if (key == "name")
+                schema.setName(text);
+            else if (key == "version")
+                schema.setVersion(text);
+            else
+                schema.setPrefix(text);
+            return true;
+        }
+        return skipValue();
+    });
+    if (!ok)
+        return false;
+
+    skipWhitespace();
+    if (m_pos != m_end)
+        return fail("Unexpected data after document");
+    if (format < 1 || format > Schema::Format)
+        return fail(QString{"Unsupported format %1"}.arg(format));
+    if (type != Schema::Flat && type != Schema::Deep)
+        return fail(QString{"Unsupported schema type %1"}.arg(type));
+
+    schema.setType(static_cast<Schema::Type>(type));
+    schema.clearChanged();
+    return true;
+}
+
+QString SchemaReader::errorString() const
+{
+    return m_error;
+}
+
+bool SchemaReader::readAntecedents(Schema &schema)
+{
+    // Format 1 keys antecedents by number, format 2 by ZMK code
+    return readObject([this, &schema](QByteArrayView key) {
+        int type{0};
+        for (char c: key) {
+            if (c < '0' || c > '9') {
+                type = Antecedent::typeOfZMKCode(QString::fromLatin1(key.data(), key.size()));
+                break;
+            }
+            if (type >= Schema::AntecedentCount)
+                break;
+            type = type * 10 + (c - '0');
+        }
+        if (key.isEmpty() || type < 0 || type >= Schema::AntecedentCount)
+            return skipValue();
+
+        return readAntecedent(schema.child(type));
+    });
+}
+
+bool SchemaReader::readAntecedent(SchemaItem *antecedent)
+{
+    QString note;
+    return readObject([&](QByteArrayView key) {
+        if (key == "note") {
+            if (!readString(note))
+                return false;
+            antecedent->setAntecedentNote(note);
+            return true;
+        }
+        if (key == "layers") {
+            return readArray([&](int index) {
+                if (index >= antecedent->childCount(Schema::Deep))
+                    return skipValue();
+                return readLayer(antecedent, index);
+            });
+        }
+        auto const layer = indexOfKey<LayerType, Antecedent::LayerCount>(key, &Layer::key);
+        if (layer >= 0)
+            return readSparseLayer(antecedent, layer);
+        return skipValue();
+    });
+}
+
+bool SchemaReader::readLayer(SchemaItem *antecedent, int layer)
+{
+    return readObject([&](QByteArrayView key) {
+        if (key == "morphs") {
+            return readArray([&](int index) {
+                if (index >= Layer::morphCount(static_cast<LayerType>(layer)))
+                    return skipValue();
+                return readMorph(antecedent, layer, index);
+            });
+        }
+        return skipValue();
+    });
+}
+
+bool SchemaReader::readSparseLayer(SchemaItem *antecedent, int layer)
+{
+    // The layer is only materialized by readMorph(), once a cell turns out
+    // not to be blank
+    auto const layerType = static_cast<LayerType>(layer);
+    return readObject([&](QByteArrayView key) {
+        auto const type = indexOfKey<MorphType, Layer::MaxMorphCount>(key, &Morph::key);
+        if (type < 0)
+            return skipValue();
+        auto const row = Layer::indexOf(layerType, static_cast<MorphType>(type));
+        if (row < 0 || row >= Layer::morphCount(layerType))
+            return skipValue();
+        return readMorph(antecedent, layer, row);
+    });
+}
+
+bool SchemaReader::readMorph(SchemaItem *antecedent, int layer, int row)
+{
+    Cell morph;
+    Cell mods[Morph::ModCount];
+    bool const ok = readObject([&](QByteArrayView key) {
+        if (key == "mode")
+            return readInt(morph.mode);
+        if (key == "value")
+            return readString(morph.value);
+        if (key == "mods") {
+            return readArray([&](int index) {
+                return index < Morph::ModCount ? readCell(mods[index]) : skipValue();
+            });
+        }
+        auto const mod = indexOfKey<ModType, Morph::ModCount>(key, &Mod::key);
+        return mod >= 0 ? readCell(mods[mod]) : skipValue();
+    });
+    if (!ok)
+        return false;
+    if (!isValidMode(morph.mode) || !std::all_of(std::begin(mods), std::end(mods),
+                                                 [](Cell const &cell) { return isValidMode(cell.mode); }))
+        return fail("Invalid mode");
+
+    // Blank cells, and the deep layers holding only those, stay unmaterialized
+    auto const isBlank = [](Cell const &cell) {
+        return cell.mode == static_cast<int>(Mode::Text) && cell.value.isEmpty();
+    };
+    if (isBlank(morph) && std::all_of(std::begin(mods), std::end(mods), isBlank))
+        return true;
+
+    auto *item = antecedent->child(layer)->child(row);
+    item->setMode(morph.mode);
+    item->setValue(morph.value);
+    for (int i = 0; i < Morph::ModCount; ++i) {
+        if (isBlank(mods[i]))
+            continue;
+        item->child(i)->setMode(mods[i].mode);
+        item->child(i)->setValue(mods[i].value);
+    }
+    return true;
+}
+
+bool SchemaReader::readCell(Cell &cell)
+{
+    return readObject([&](QByteArrayView key) {
+        if (key == "mode")
+            return readInt(cell.mode);
+        if (key == "value")
+            return readString(cell.value);
+        return skipValue();
+    });
+}
+
+bool SchemaReader::readKey(QByteArrayView &key)
+{
+    if (!consume('"'))
+        return fail("Expected key");
+
+    auto const *begin = m_pos;
+    while (m_pos != m_end && *m_pos != '"') {
+        if (*m_pos == '\\')
+            return fail("Escaped keys are not supported");
+        ++m_pos;
+    }
+    if (m_pos == m_end)
+        return fail("Unterminated key");
+
+    key = QByteArrayView{begin, m_pos - begin};
+    ++m_pos;
+    return true;
+}
+
+bool SchemaReader::readString(QString &out)
+{
+    out.clear();
+    skipWhitespace();
+    if (m_pos != m_end && *m_pos == 'n')
+        return skipLiteral("null");
+    if (!consume('"'))
+        return fail("Expected string");
+
+    auto const *run = m_pos;
+    while (m_pos != m_end) {
+        char const c = *m_pos;
+        if (c == '"') {
+            if (m_pos != run)
+                out += QString::fromUtf8(run, m_pos - run);
+            ++m_pos;
+            return true;
+        }
+        if (static_cast<unsigned char>(c) < 0x20)
+            return fail("Control character in string");
+        if (c != '\\') {
+            ++m_pos;
+            continue;
+        }
+
+        if (m_pos != run)
+            out += QString::fromUtf8(run, m_pos - run);
+        if (++m_pos == m_end)
+            break;
+        switch (*m_pos++) {
+            case '"': out += QChar{u'"'}; break;
+            case '\\': out += QChar{u'\\'}; break;
+            case '/': out += QChar{u'/'}; break;
+            case 'b': out += QChar{u'\b'}; break;
+            case 'f': out += QChar{u'\f'}; break;
+            case 'n': out += QChar{u'\n'}; break;
+            case 'r': out += QChar{u'\r'}; break;
+            case 't': out += QChar{u'\t'}; break;
+            case 'u': {
+                if (m_end - m_pos < 4)
+                    return fail("Truncated escape");
+                char16_t code{0};
+                for (int i = 0; i < 4; ++i) {
+                    char const h = *m_pos++;
+                    code <<= 4;
+                    if (h >= '0' && h <= '9')
+                        code |= h - '0';
+                    else if (h >= 'a' && h <= 'f')
+                        code |= h - 'a' + 10;
+                    else if (h >= 'A' && h <= 'F')
+                        code |= h - 'A' + 10;
+                    else
+                        return fail("Invalid escape");
+                }
+                out += QChar{code};
+                break;
+            }
+            default:
+                return fail("Invalid escape");
+        }
+        run = m_pos;
+    }
+    return fail("Unterminated string");
+}
+
+bool SchemaReader::readInt(int &out)
+{
+    skipWhitespace();
+    if (m_pos != m_end && *m_pos == 'n') {
+        out = 0;
+        return skipLiteral("null");
+    }
+
+    bool const negative = consume('-');
+    if (m_pos == m_end || *m_pos < '0' || *m_pos > '9')
+        return fail("Expected integer");
+
+    long long value{0};
+    while (m_pos != m_end && *m_pos >= '0' && *m_pos <= '9') {
+        value = value * 10 + (*m_pos++ - '0');
+        if (value > std::numeric_limits<int>::max())
+            return fail("Integer out of range");
+    }
+    if (m_pos != m_end && (*m_pos == '.' || *m_pos == 'e' || *m_pos == 'E'))
+        return fail("Expected integer");
+
+    out = static_cast<int>(negative ? -value : value);
+    return true;
+}
+
+bool SchemaReader::skipValue()
+{
+    skipWhitespace();
+    if (m_pos == m_end)
+        return fail("Unexpected end of document");
+
+    switch (*m_pos) {
+        case '{':
+            return readObject([this](QByteArrayView) { return skipValue(); });
+        case '[':
+            return readArray([this](int) { return skipValue(); });
+        case '"':
+            return skipString();
+        case 't':
+            return skipLiteral("true");
+        case 'f':
+            return skipLiteral("false");
+        case 'n':
+            return skipLiteral("null");
+    }
+
+    auto const *begin = m_pos;
+    while (m_pos != m_end && (std::isdigit(static_cast<unsigned char>(*m_pos))
+                              || *m_pos == '-' || *m_pos == '+' || *m_pos == '.'
+                              || *m_pos == 'e' || *m_pos == 'E'))
+    {
+        ++m_pos;
+    }
+    return m_pos != begin || fail("Unexpected character");
+}
+
+bool SchemaReader::skipString()
+{
+    if (!consume('"'))
+        return fail("Expected string");
+
+    while (m_pos != m_end) {
+        char const c = *m_pos++;
+        if (c == '"')
+            return true;
+        if (c == '\\' && m_pos != m_end)
+            ++m_pos;
+    }
+    return fail("Unterminated string");
+}
+
+bool SchemaReader::skipLiteral(QByteArrayView literal)
+{
+    if (m_end - m_pos < literal.size() || QByteArrayView{m_pos, literal.size()} != literal)
+        return fail("Unexpected literal");
+
+    m_pos += literal.size();
+    return true;
+}
+
+void SchemaReader::skipWhitespace()
+{
+    while (m_pos != m_end && (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t'))
+        ++m_pos;
+}
+
+bool SchemaReader::consume(char c)
+{
+    skipWhitespace();
+    if (m_pos == m_end || *m_pos != c)
+        return false;
+
+    ++m_pos;
+    return true;
+}
+
+bool SchemaReader::fail(const QString &error)
+{
+    if (m_error.isEmpty())
+        m_error = QString{"%1 at offset %2"}.arg(error).arg(m_pos - m_begin);
+    return false;
+}
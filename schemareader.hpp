@@ -0,0 +1,58 @@
+#ifndef SCHEMAREADER_HPP
+#define SCHEMAREADER_HPP
+
+#include <QByteArrayView>
+#include <QString>
+
+class Schema;
+class SchemaItem;
+class Layer;
+
+// Reads .amconf JSON (format 1 or 2) straight into a Schema without building
+// a document first. Anything it does not understand makes read() fail, so
+// callers can fall back to QJsonDocument and Schema::fromJson.
+class SchemaReader
+{
+public:
+    SchemaReader() = default;
+
+    bool read(QByteArrayView data, Schema &schema);
+    QString errorString() const;
+
+private:
+    struct Cell {
+        int mode{0};
+        QString value{};
+    };
+
+    bool readAntecedents(Schema &schema);
+    bool readAntecedent(SchemaItem *antecedent);
+    bool readLayer(SchemaItem *antecedent, int layer);
+    bool readSparseLayer(SchemaItem *antecedent, int layer);
+    bool readMorph(SchemaItem *antecedent, int layer, int row);
+    bool readCell(Cell &cell);
+
+    template <typename F>
+    bool readObject(F onKey);
+    template <typename F>
+    bool readArray(F onElement);
+
+    bool readKey(QByteArrayView &key);
+    bool readString(QString &out);
+    bool readInt(int &out);
+    bool skipValue();
+    bool skipString();
+    bool skipLiteral(QByteArrayView literal);
+
+    void skipWhitespace();
+    bool consume(char c);
+    bool fail(QString const &error);
+
+private:
+    char const *m_begin{nullptr};
+    char const *m_pos{nullptr};
+    char const *m_end{nullptr};
+    QString m_error{};
+};
+
+#endif // SCHEMAREADER_HPP
@@ -0,0 +1,66 @@
+#include "schemasnapshot.hpp"
+
+SchemaSnapshot::SchemaSnapshot()
+    : d{}
+{
+
+}
+
+SchemaSnapshot::SchemaSnapshot(std::shared_ptr<const Data> data)
+    : d{std::move(data)}
+{
+
+}
+
+bool SchemaSnapshot::isNull() const
+{
+    return !d;
+}
+
+QString SchemaSnapshot::filePath() const
+{
+    return d ? d->filePath : QString{};
+}
+
+QString SchemaSnapshot::name() const
+{
+    return d ? d->name : QString{};
+}
+
+QString SchemaSnapshot::version() const
+{
+    return d ? d->version : QString{};
+}
+
+Schema::Type SchemaSnapshot::type() const
+{
+    return d ? d->type : Schema::Flat;
+}
+
+QString SchemaSnapshot::prefix() const
+{
+    return d ? d->prefix : QString{};
+}
+
+QJsonObject SchemaSnapshot::antecedent(Antecedent::Type type) const
+{
+    return d ? d->antecedents[type] : QJsonObject{};
+}
+
+QJsonDocument SchemaSnapshot::toJson() const
+{
+    QJsonObject schema;
+    schema["format"] = Schema::Format;
+    schema["name"] = name();
+    schema["version"] = version();
+    schema["type"] = type();
+    schema["prefix"] = prefix();
+    QJsonObject antecedents;
+    for (int type = Antecedent::A; d && type <= Antecedent::Space; ++type) {
+        if (!d->antecedents[type].isEmpty())
+            antecedents[Antecedent::ZMKCode(static_cast<Antecedent::Type>(type)).toString()] = d->antecedents[type];
+    }
+    schema["antecedents"] = antecedents;
+
+    return QJsonDocument{schema};
+}
@@ -0,0 +1,48 @@
+#ifndef SCHEMASNAPSHOT_HPP
+#define SCHEMASNAPSHOT_HPP
+
+#include "schema.hpp"
+#include <QJsonObject>
+#include <array>
+#include <memory>
+
+// Immutable view of a schema taken by Schema::snapshot(). Copies share one
+// payload, and each antecedent in it is implicitly shared sparse JSON that
+// later snapshots reuse while the antecedent is unchanged. Snapshots can be
+// read from any thread.
+class SchemaSnapshot
+{
+public:
+    friend class Schema;
+public:
+    SchemaSnapshot();
+
+    bool isNull() const;
+
+    QString filePath() const;
+    QString name() const;
+    QString version() const;
+    Schema::Type type() const;
+    QString prefix() const;
+
+    QJsonObject antecedent(Antecedent::Type type) const;
+
+    QJsonDocument toJson() const;
+
+private:
+    struct Data {
+        QString filePath{};
+        QString name{};
+        QString version{};
+        Schema::Type type{Schema::Flat};
+        QString prefix{};
+        std::array<QJsonObject, Schema::AntecedentCount> antecedents{};
+    };
+
+    explicit SchemaSnapshot(std::shared_ptr<Data const> data);
+
+private:
+    std::shared_ptr<Data const> d;
+};
+
+#endif // SCHEMASNAPSHOT_HPP
@@ -0,0 +1,110 @@
+#include "schemawatcher.hpp"
+#include "outputfile.hpp"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <utility>
+
+namespace {
+
+constexpr int SettleInterval = 20;
+// Saving by delete and rename leaves the file missing for a moment
+constexpr int MaxMissingRetries = 5;
+
+}
+
+SchemaWatcher::SchemaWatcher(CodeGenerator::Firmware firmware, const QString &outputDir, QObject *parent)
+    : QObject{parent},
+      m_batch{firmware, outputDir},
+      m_firmware{firmware},
+      m_watcher{new QFileSystemWatcher{this}},
+      m_settleTimer{new QTimer{this}},
+      m_pending{},
+      m_missing{}
+{
+    // Editors often save in several steps, let them settle first
+    m_settleTimer->setSingleShot(true);
+    m_settleTimer->setInterval(SettleInterval);
+    connect(m_settleTimer, &QTimer::timeout, this, &SchemaWatcher::regeneratePending);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &SchemaWatcher::fileChanged);
+}
+
+SchemaWatcher::~SchemaWatcher() = default;
+
+void SchemaWatcher::setOptimizations(int optimizations)
+{
+    m_batch.setOptimizations(optimizations);
+}
+
+void SchemaWatcher::setMinSuffixLength(int keys)
+{
+    m_batch.setMinSuffixLength(keys);
+}
+
+void SchemaWatcher::watch(const QStringList &filePaths)
+{
+    for (auto const &filePath: filePaths) {
+        m_watcher->addPath(filePath);
+        regenerate(filePath);
+    }
+}
+
+void SchemaWatcher::regenerate(const QString &filePath)
+{
+    QByteArray output;
+    auto result = BatchGenerator::generate(filePath, m_firmware, output, m_batch.optimizations(),
+                                           m_batch.minSuffixLength());
+    result.outputPath = m_batch.outputPathFor(filePath);
+    if (result.status == BatchGenerator::Success) {
+        QElapsedTimer timer;
+        timer.start();
+        auto const written = OutputFile::write(result.outputPath, output, &result.message);
+        if (written == OutputFile::Failed)
+            result.status = BatchGenerator::WriteError;
+        result.unchanged = written == OutputFile::Unchanged;
+        result.elapsed += timer.nsecsElapsed();
+    }
+    emit regenerated(result);
+}
+
+void SchemaWatcher::fileChanged(const QString &filePath)
+{
+    m_pending.insert(filePath);
+    m_settleTimer->start();
+}
+
+void SchemaWatcher::regeneratePending()
+{
+    auto const pending = std::exchange(m_pending, {});
+    for (auto const &filePath: pending) {
+        // Saving by rename replaces the watched file and drops it from the watcher
+        if (!m_watcher->files().contains(filePath)) {
+            if (!QFileInfo::exists(filePath)) {
+                retryMissing(filePath);
+                continue;
+            }
+            m_watcher->addPath(filePath);
+        }
+        m_missing.remove(filePath);
+        regenerate(filePath);
+    }
+}
+
+void SchemaWatcher::retryMissing(const QString &filePath)
+{
+    auto const attempt = ++m_missing[filePath];
+    if (attempt <= MaxMissingRetries) {
+        QTimer::singleShot(SettleInterval << attempt, this, [this, filePath] { fileChanged(filePath); });
+        return;
+    }
+
+    m_missing.remove(filePath);
+
+    BatchGenerator::Result result;
+    result.filePath = filePath;
+    result.outputPath = m_batch.outputPathFor(filePath);
+    result.status = BatchGenerator::LoadError;
+    result.message = "File was removed, no longer watching it";
+    emit regenerated(result);
+}
@@ -0,0 +1,44 @@
+#ifndef SCHEMAWATCHER_HPP
+#define SCHEMAWATCHER_HPP
+
+#include "batchgenerator.hpp"
+#include <QHash>
+#include <QObject>
+#include <QSet>
+
+class QFileSystemWatcher;
+class QTimer;
+
+// Regenerates schema files whenever they are saved. Every save reloads the
+// file and generates it in full, as a batch run would.
+class SchemaWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    SchemaWatcher(CodeGenerator::Firmware firmware, QString const &outputDir, QObject *parent = nullptr);
+    ~SchemaWatcher() override;
+
+    void setOptimizations(int optimizations);
+    void setMinSuffixLength(int keys);
+
+    void watch(QStringList const &filePaths);
+    void regenerate(QString const &filePath);
+
+signals:
+    void regenerated(BatchGenerator::Result const &result);
+
+private:
+    void fileChanged(QString const &filePath);
+    void regeneratePending();
+    void retryMissing(QString const &filePath);
+
+private:
+    BatchGenerator m_batch;
+    CodeGenerator::Firmware m_firmware;
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_settleTimer;
+    QSet<QString> m_pending;
+    QHash<QString, int> m_missing;
+};
+
+#endif // SCHEMAWATCHER_HPP
@@ -0,0 +1,60 @@
+#include "schema.hpp"
+#include "schemareader.hpp"
+#include <QJsonDocument>
+#include <QTest>
+
+// Loads a Deep schema with every cell set through the streaming reader and
+// through QJsonDocument + Schema::fromJson, the fallback it replaced
+class BenchSchemaLoad : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void load_data();
+    void load();
+
+private:
+    void fill(SchemaItem *item, int &count);
+};
+
+void BenchSchemaLoad::fill(SchemaItem *item, int &count)
+{
+    for (int row = 0; row < item->childCount(Schema::Deep); ++row) {
+        auto *child = item->child(row);
+        if (child->isEditable())
+            child->setValue(QString{"w%1 "}.arg(count++));
+        fill(child, count);
+    }
+}
+
+void BenchSchemaLoad::load_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("streaming");
+
+    Schema schema{Schema::Deep};
+    int count{0};
+    fill(&schema, count);
+
+    for (int format: {1, Schema::Format}) {
+        auto const data = schema.toJson(format).toJson();
+        QTest::addRow("format %d, reader", format) << data << true;
+        QTest::addRow("format %d, document", format) << data << false;
+    }
+}
+
+void BenchSchemaLoad::load()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, streaming);
+
+    QBENCHMARK {
+        Schema schema{Schema::Flat};
+        SchemaReader reader;
+        QVERIFY2(streaming ? reader.read(data, schema) : schema.fromJson(QJsonDocument::fromJson(data)),
+                 qPrintable(reader.errorString()));
+    }
+}
+
+QTEST_GUILESS_MAIN(BenchSchemaLoad)
+#include "bench_schemaload.moc"
@@ -0,0 +1,48 @@
+#include "schema.hpp"
+#include "schemamodel.hpp"
+#include <QTest>
+
+// Walks every index of a Deep schema the way a view expanding all rows does
+class BenchSchemaModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void traverse();
+
+private:
+    int visit(SchemaModel const &model, QModelIndex const &parent, int &mismatches);
+};
+
+int BenchSchemaModel::visit(SchemaModel const &model, QModelIndex const &parent, int &mismatches)
+{
+    int count{0};
+    int const rows = model.rowCount(parent);
+    for (int row = 0; row < rows; ++row) {
+        auto const index = model.index(row, SchemaModel::NameColumn, parent);
+        if (model.parent(index) != parent)
+            ++mismatches;
+        count += 1 + visit(model, index, mismatches);
+    }
+    return count;
+}
+
+void BenchSchemaModel::traverse()
+{
+    Schema schema{Schema::Deep};
+    SchemaModel model{&schema, nullptr};
+
+    // The first walk materializes the items, the benchmark measures lookups
+    int mismatches{0};
+    int const count = visit(model, {}, mismatches);
+    QVERIFY(count > 0);
+    QCOMPARE(mismatches, 0);
+
+    QBENCHMARK {
+        visit(model, {}, mismatches);
+    }
+    QCOMPARE(mismatches, 0);
+}
+
+QTEST_GUILESS_MAIN(BenchSchemaModel)
+#include "bench_schemamodel.moc"
@@ -0,0 +1,163 @@
+#include "schema.hpp"
+#include "schemafile.hpp"
+#include "schemareader.hpp"
+#include <QFile>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <QTest>
+#include <functional>
+
+// Round-trips the schemas in data/ through the file formats
+class TestSchemaFile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void binaryRoundTrip_data();
+    void binaryRoundTrip();
+    void corruptBinary();
+    void formatRoundTrip_data();
+    void formatRoundTrip();
+    void incrementalSave();
+
+private:
+    void addSchemas();
+
+private:
+    QTemporaryDir m_dir;
+};
+
+void TestSchemaFile::addSchemas()
+{
+    QTest::addColumn<QString>("name");
+
+    for (auto const *name: {"flat", "deep", "sparse", "suffixes"})
+        QTest::newRow(name) << QString{name};
+}
+
+void TestSchemaFile::binaryRoundTrip_data()
+{
+    addSchemas();
+}
+
+void TestSchemaFile::binaryRoundTrip()
+{
+    QFETCH(QString, name);
+
+    Schema schema{Schema::Flat};
+    QString error;
+    QVERIFY2(SchemaFile::load(AMCONF_TEST_DATA "/" + name + ".amconf", schema, &error), qPrintable(error));
+
+    auto const filePath = m_dir.filePath(name + "." + SchemaFile::BinarySuffix);
+    QVERIFY2(SchemaFile::save(filePath, schema, &error), qPrintable(error));
+    Schema loaded{Schema::Flat};
+    QVERIFY2(SchemaFile::load(filePath, loaded, &error), qPrintable(error));
+
+    QCOMPARE(loaded.toJson().toJson(), schema.toJson().toJson());
+    QCOMPARE(loaded.toBinary(), schema.toBinary());
+    QVERIFY(!loaded.isChanged());
+}
+
+void TestSchemaFile::corruptBinary()
+{
+    Schema schema{Schema::Flat};
+    QString error;
+    QVERIFY2(SchemaFile::load(AMCONF_TEST_DATA "/deep.amconf", schema, &error), qPrintable(error));
+    auto const data = schema.toBinary();
+    auto const json = schema.toJson().toJson();
+
+    // A truncated file on disk fails to load with an error
+    auto const filePath = m_dir.filePath(QString{"truncated."} + SchemaFile::BinarySuffix);
+    QFile file{filePath};
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(data.first(data.size() / 2)), data.size() / 2);
+    file.close();
+    Schema loaded{Schema::Flat};
+    QVERIFY(!SchemaFile::load(filePath, loaded, &error));
+    QCOMPARE(error, QString{"Corrupt binary schema"});
+
+    // Every truncation and every extension is refused, and leaves the
+    // schema as it was
+    for (qsizetype size = 0; size < data.size(); ++size)
+        QVERIFY2(!schema.fromBinary(data.first(size)), qPrintable(QString::number(size)));
+    QVERIFY(!schema.fromBinary(data + '\0'));
+    QCOMPARE(schema.toJson().toJson(), json);
+
+    // Damaged bytes either still make a valid schema or are refused without
+    // touching the one loaded
+    for (qsizetype i = 0; i < data.size(); ++i) {
+        auto damaged = data;
+        damaged[i] = char(~damaged[i]);
+        Schema target{Schema::Flat};
+        QVERIFY(target.fromBinary(data));
+        if (!target.fromBinary(damaged))
+            QCOMPARE(target.toJson().toJson(), json);
+    }
+}
+
+void TestSchemaFile::formatRoundTrip_data()
+{
+    addSchemas();
+}
+
+void TestSchemaFile::formatRoundTrip()
+{
+    QFETCH(QString, name);
+
+    Schema schema{Schema::Flat};
+    QString error;
+    QVERIFY2(SchemaFile::load(AMCONF_TEST_DATA "/" + name + ".amconf", schema, &error), qPrintable(error));
+    auto const format1 = schema.toJson(1).toJson();
+
+    // SchemaFile falls back from one path to the other, so each is checked
+    // on its own, in every combination
+    auto const read = [](bool streaming, QByteArray const &data, Schema &schema) {
+        return streaming ? SchemaReader{}.read(data, schema) : schema.fromJson(QJsonDocument::fromJson(data));
+    };
+    for (bool streaming1: {true, false}) {
+        Schema loaded{Schema::Flat};
+        QVERIFY(read(streaming1, format1, loaded));
+        QCOMPARE(loaded.toJson(1).toJson(), format1);
+        auto const format2 = loaded.toJson(2).toJson();
+
+        for (bool streaming2: {true, false}) {
+            Schema reloaded{Schema::Flat};
+            QVERIFY(read(streaming2, format2, reloaded));
+            QCOMPARE(reloaded.toJson(1).toJson(), format1);
+            QCOMPARE(reloaded.toJson(2).toJson(), format2);
+        }
+    }
+}
+
+void TestSchemaFile::incrementalSave()
+{
+    Schema schema{Schema::Flat};
+    QString error;
+    QVERIFY2(SchemaFile::load(AMCONF_TEST_DATA "/deep.amconf", schema, &error), qPrintable(error));
+    QCOMPARE(schema.toJsonData(), QJsonDocument{schema.toJson()}.toJson());
+
+    // Each edit must drop the cached fragment of its antecedent
+    auto const item = [&schema](int antecedent, LayerType layerType, MorphType morphType, int modType = -1) {
+        auto *item = schema.child(antecedent)->child(int(layerType))->child(Layer::indexOf(layerType, morphType));
+        return modType < 0 ? item : item->child(modType);
+    };
+    auto const edits = std::initializer_list<std::pair<char const*, std::function<void()>>>{
+        {"mod", [&] { item(0, LayerType::Base, MorphType::NorthEast, int(ModType::Control))->setValue("always "); }},
+        {"morph", [&] { item(19, LayerType::Base, MorphType::East)->setValue("then "); }},
+        {"deep layer", [&] { item(14, LayerType::Number, MorphType::NorthWest)->setValue("one "); }},
+        {"deep layer mode", [&] { item(8, LayerType::Media, MorphType::East)->setMode(int(Mode::SchemaName)); }},
+        {"cleared cell", [&] { item(22, LayerType::Number, MorphType::SouthWest, int(ModType::Control))->setValue({}); }},
+        {"note", [&] { schema.child(0)->setAntecedentNote("left pinky"); }},
+        {"prefix", [&] { schema.setPrefix("h"); }},
+    };
+    for (auto const &[name, edit]: edits) {
+        edit();
+        QVERIFY2(schema.toJsonData() == QJsonDocument{schema.toJson()}.toJson(), name);
+        // Fragments cached while the schema was saved are reused afterwards
+        schema.clearChanged();
+        QVERIFY2(schema.toJsonData() == QJsonDocument{schema.toJson()}.toJson(), name);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestSchemaFile)
+#include "tst_schemafile.moc"
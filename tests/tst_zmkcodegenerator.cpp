@@ -0,0 +1,199 @@
+#include "schema.hpp"
+#include "schemafile.hpp"
+#include "zmkcodegenerator.hpp"
+#include <QFile>
+#include <QHash>
+#include <QTest>
+#include <QTextStream>
+
+namespace {
+
+QString generate(ZmkCodeGenerator &generator)
+{
+    QString output;
+    QTextStream out{&output};
+    generator.generate(out);
+    out.flush();
+    return output;
+}
+
+// Each antecedent's binding in the antecedent-morph behavior labelled label
+QHash<QString, QString> bindingsOf(QString const &output, QString const &label)
+{
+    auto const node = output.indexOf(QString{"        %1: "}.arg(label));
+    auto const line = [&](QString const &property) {
+        auto const start = output.indexOf(property + " = <", node) + property.size() + 4;
+        return output.mid(start, output.indexOf(">;\n", start) - start);
+    };
+    if (node < 0)
+        return {};
+
+    auto const bindings = line("bindings").split(">, <");
+    auto const antecedents = line("antecedents").split(' ');
+    QHash<QString, QString> result;
+    for (qsizetype i = 0; i < bindings.size() && i < antecedents.size(); ++i)
+        result.insert(antecedents[i], bindings[i]);
+    return result;
+}
+
+void setCell(Schema &schema, int antecedent, LayerType layerType, MorphType morphType, int modType,
+             QString const &value)
+{
+    auto *item = schema.child(antecedent)->child(int(layerType))->child(Layer::indexOf(layerType, morphType));
+    if (modType >= 0)
+        item = item->child(modType);
+    item->setValue(value);
+}
+
+}
+
+// Generates the schemas in data/ and compares them to golden files. Those
+// without optimizations come from the generator before any optimizations
+// were added
+class TestZmkCodeGenerator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void generate_data();
+    void generate();
+    void deduplicateMacros();
+    void factorSuffixesOutsideBmp();
+};
+
+void TestZmkCodeGenerator::generate_data()
+{
+    QTest::addColumn<QString>("schema");
+    QTest::addColumn<int>("optimizations");
+    QTest::addColumn<int>("minSuffixLength");
+    QTest::addColumn<QString>("golden");
+
+    QTest::newRow("flat") << "flat" << int(ZmkCodeGenerator::NoOptimization)
+            << int(ZmkCodeGenerator::DefaultMinSuffixLength) << "flat.dtsi";
+    QTest::newRow("deep") << "deep" << int(ZmkCodeGenerator::NoOptimization)
+            << int(ZmkCodeGenerator::DefaultMinSuffixLength) << "deep.dtsi";
+    QTest::newRow("flat, default") << "flat" << ZmkCodeGenerator::DefaultOptimizations
+            << int(ZmkCodeGenerator::DefaultMinSuffixLength) << "flat.opt.dtsi";
+    QTest::newRow("deep, default") << "deep" << ZmkCodeGenerator::DefaultOptimizations
+            << int(ZmkCodeGenerator::DefaultMinSuffixLength) << "deep.opt.dtsi";
+    // Empty directions, and layers without any cell
+    QTest::newRow("sparse, default") << "sparse" << ZmkCodeGenerator::DefaultOptimizations
+            << int(ZmkCodeGenerator::DefaultMinSuffixLength) << "sparse.opt.dtsi";
+    QTest::newRow("sparse, pruned") << "sparse" << int(ZmkCodeGenerator::PruneDeadBehaviors)
+            << int(ZmkCodeGenerator::DefaultMinSuffixLength) << "sparse.prune.dtsi";
+    // Shared endings after merged and typed first letters; three keys
+    // factor out "ion " where five keep "tion "
+    QTest::newRow("suffixes, 3 keys") << "suffixes"
+            << (ZmkCodeGenerator::DefaultOptimizations | ZmkCodeGenerator::FactorSuffixes) << 3
+            << "suffixes.sfx3.dtsi";
+    QTest::newRow("suffixes, 5 keys") << "suffixes"
+            << (ZmkCodeGenerator::DefaultOptimizations | ZmkCodeGenerator::FactorSuffixes) << 5
+            << "suffixes.sfx5.dtsi";
+    // One direction each for no mods, only Ctrl, only GUI, Ctrl and GUI,
+    // only Alt and all three
+    QTest::newRow("mods, default") << "mods" << ZmkCodeGenerator::DefaultOptimizations
+            << int(ZmkCodeGenerator::DefaultMinSuffixLength) << "mods.opt.dtsi";
+}
+
+void TestZmkCodeGenerator::generate()
+{
+    QFETCH(QString, schema);
+    QFETCH(int, optimizations);
+    QFETCH(int, minSuffixLength);
+    QFETCH(QString, golden);
+
+    Schema s{Schema::Flat};
+    QString error;
+    QVERIFY2(SchemaFile::load(AMCONF_TEST_DATA "/" + schema + ".amconf", s, &error), qPrintable(error));
+
+    ZmkCodeGenerator generator{&s};
+    generator.setOptimizations(optimizations);
+    generator.setMinSuffixLength(minSuffixLength);
+    auto const verifyResult = generator.verify();
+    QVERIFY2(verifyResult.first, qPrintable(verifyResult.second));
+    auto const prepareResult = generator.prepare();
+    QVERIFY2(prepareResult.first, qPrintable(prepareResult.second));
+
+    QByteArray output;
+    QTextStream out{&output, QIODevice::WriteOnly};
+    generator.generate(out);
+    out.flush();
+
+    QFile file{AMCONF_TEST_DATA "/" + golden};
+    QVERIFY2(file.open(QFile::ReadOnly), qPrintable(file.errorString()));
+    QCOMPARE(output, file.readAll());
+}
+
+void TestZmkCodeGenerator::deduplicateMacros()
+{
+    enum {A, B, C, D};
+    int const ctrl = int(ModType::Control);
+    Schema schema{Schema::Deep};
+    schema.setPrefix("g");
+    // A merges the first letter, B, C and D type it after a backspace
+    for (auto antecedent: {A, B, C})
+        setCell(schema, antecedent, LayerType::Base, MorphType::NorthEast, -1, "and ");
+    setCell(schema, D, LayerType::Navigation, MorphType::NorthEast, -1, "and ");
+    // Ctrl is released before typing, on the side of the morph
+    for (auto antecedent: {A, B, C})
+        setCell(schema, antecedent, LayerType::Base, MorphType::NorthEast, ctrl, "and ");
+    setCell(schema, A, LayerType::Base, MorphType::NorthWest, ctrl, "and ");
+
+    ZmkCodeGenerator generator{&schema};
+    QVERIFY(generator.verify().first);
+    auto const prepareResult = generator.prepare();
+    QVERIFY(prepareResult.first);
+    QCOMPARE(prepareResult.second, QString{"3 repeated macros shared, about 348 bytes of flash saved"});
+
+    auto const output = generate(generator);
+    QCOMPARE(output.count(QString{"compatible = \"zmk,behavior-macro\""}), qsizetype(5));
+
+    auto const base = bindingsOf(output, "amgne");
+    auto const baseCtrl = bindingsOf(output, "amgnec");
+    auto const navigation = bindingsOf(output, "amgnavne");
+    auto const westCtrl = bindingsOf(output, "amgnwc");
+    QCOMPARE(base.size(), qsizetype(3));
+    QCOMPARE(baseCtrl.size(), qsizetype(3));
+    QCOMPARE(navigation.size(), qsizetype(1));
+    QCOMPARE(westCtrl.size(), qsizetype(1));
+
+    QVERIFY(base["A"] != base["B"]);
+    QCOMPARE(base["C"], base["B"]);
+    QCOMPARE(navigation["D"], base["B"]);
+    QVERIFY(baseCtrl["A"] != base["A"]);
+    QVERIFY(baseCtrl["A"] != westCtrl["A"]);
+    QVERIFY(baseCtrl["B"] != baseCtrl["A"]);
+    QVERIFY(baseCtrl["B"] != base["B"]);
+    QCOMPARE(baseCtrl["C"], baseCtrl["B"]);
+}
+
+void TestZmkCodeGenerator::factorSuffixesOutsideBmp()
+{
+    // No keycode exists outside the BMP, so verify() refuses these values;
+    // preparing them still shows where the cuts fall
+    Schema schema{Schema::Flat};
+    schema.setPrefix("g");
+    int const antecedents[] = {23, 24, 25};
+    QStringList const values = {QString::fromUtf8("a😀tion "), QString::fromUtf8("e😀tion "),
+                                QString::fromUtf8("i😀tion ")};
+    for (qsizetype i = 0; i < values.size(); ++i)
+        setCell(schema, antecedents[i], LayerType::Base, MorphType::NorthEast, -1, values[i]);
+
+    ZmkCodeGenerator generator{&schema};
+    generator.setOptimizations(ZmkCodeGenerator::DefaultOptimizations | ZmkCodeGenerator::FactorSuffixes);
+    auto const verifyResult = generator.verify();
+    QVERIFY(!verifyResult.first);
+    QVERIFY(verifyResult.second.endsWith(QString::fromUtf8("Invalid symbol: 😀")));
+    auto const prepareResult = generator.prepare();
+    QVERIFY(prepareResult.first);
+    QCOMPARE(prepareResult.second, QString{"1 suffixes factored out of 3 macros, about 48 bytes of flash saved"});
+
+    auto const output = generate(generator);
+    QVERIFY(output.contains(QString::fromUtf8("// ...😀tion \n")));
+    QVERIFY(output.contains(QString{"bindings = <&macro_tap &kp BSPC &kp A &amg_sfx_tion>;"}));
+    QVERIFY(output.contains(QString{"bindings = <&macro_tap &kp BSPC &kp E &amg_sfx_tion>;"}));
+    QVERIFY(output.contains(QString{"bindings = <&macro_tap &kp BSPC &kp I &amg_sfx_tion>;"}));
+}
+
+QTEST_GUILESS_MAIN(TestZmkCodeGenerator)
+#include "tst_zmkcodegenerator.moc"
@@ -1,47 +1,347 @@
 #include "zmkcodegenerator.hpp"
 #include "schema.hpp"
+#include <algorithm>
+
+namespace {
+
+struct Keycode
+{
+    constexpr Keycode() = default;
+    template <std::size_t N>
+    constexpr Keycode(char32_t codePoint, char const (&keycode)[N])
+        : codePoint{codePoint}, keycode{keycode, N - 1}
+    { }
+
+    char32_t codePoint{0};
+    QLatin1StringView keycode{};
+};
+
+constexpr Keycode Keycodes[] = {
+    {U'a', "A"},
+    {U'b', "B"},
+    {U'c', "C"},
+    {U'd', "D"},
+    {U'e', "E"},
+    {U'f', "F"},
+    {U'g', "G"},
+    {U'h', "H"},
+    {U'i', "I"},
+    {U'j', "J"},
+    {U'k', "K"},
+    {U'l', "L"},
+    {U'm', "M"},
+    {U'n', "N"},
+    {U'o', "O"},
+    {U'p', "P"},
+    {U'q', "Q"},
+    {U'r', "R"},
+    {U's', "S"},
+    {U't', "T"},
+    {U'u', "U"},
+    {U'v', "V"},
+    {U'w', "W"},
+    {U'x', "X"},
+    {U'y', "Y"},
+    {U'z', "Z"},
+
+    {U'A', "LS(A)"},
+    {U'B', "LS(B)"},
+    {U'C', "LS(C)"},
+    {U'D', "LS(D)"},
+    {U'E', "LS(E)"},
+    {U'F', "LS(F)"},
+    {U'G', "LS(G)"},
+    {U'H', "LS(H)"},
+    {U'I', "LS(I)"},
+    {U'J', "LS(J)"},
+    {U'K', "LS(K)"},
+    {U'L', "LS(L)"},
+    {U'M', "LS(M)"},
+    {U'N', "LS(N)"},
+    {U'O', "LS(O)"},
+    {U'P', "LS(P)"},
+    {U'Q', "LS(Q)"},
+    {U'R', "LS(R)"},
+    {U'S', "LS(S)"},
+    {U'T', "LS(T)"},
+    {U'U', "LS(U)"},
+    {U'V', "LS(V)"},
+    {U'W', "LS(W)"},
+    {U'X', "LS(X)"},
+    {U'Y', "LS(Y)"},
+    {U'Z', "LS(Z)"},
+
+    {U'0', "N0"},
+    {U'1', "N1"},
+    {U'2', "N2"},
+    {U'3', "N3"},
+    {U'4', "N4"},
+    {U'5', "N5"},
+    {U'6', "N6"},
+    {U'7', "N7"},
+    {U'8', "N8"},
+    {U'9', "N9"},
+
+    {U' ', "SPACE"},
+    {U'!', "EXCL"},
+    {U'@', "AT"},
+    {U'#', "HASH"},
+    {U'$', "DLLR"},
+    {U'%', "PRCNT"},
+    {U'^', "CARET"},
+    {U'&', "AMPS"},
+    {U'*', "STAR"},
+    {U'(', "LPAR"},
+    {U')', "RPAR"},
+    {U'=', "EQUAL"},
+    {U'+', "PLUS"},
+    {U'-', "MINUS"},
+    {U'_', "UNDER"},
+    {U'/', "FSLH"},
+    {U'?', "QMARK"},
+    {U'\\', "BSLH"},
+    {U'|', "PIPE"},
+    {U';', "SEMI"},
+    {U':', "COLON"},
+    {U'\'', "APOS"},
+    {U'‘', "APOS"},
+    {U'’', "APOS"},
+    {U'"', "DQT"},
+    {U'“', "DQT"},
+    {U'”', "DQT"},
+    {U',', "COMMA"},
+    {U'.', "DOT"},
+    {U'>', "GT"},
+    {U'<', "LT"},
+    {U'[', "LBKT"},
+    {U']', "RBKT"},
+    {U'{', "LBRC"},
+    {U'}', "RBRC"},
+    {U'`', "GRAVE"},
+    {U'~', "TILDE"},
+
+    {U'←', "LEFT"},
+    {U'⏎', "RET"},
+
+    {U'é', "E"}
+};
+
+// Dense table for ASCII, indexed by code point
+constexpr auto AsciiKeycodes = [] {
+    std::array<QLatin1StringView, 128> table{};
+    for (auto const &k: Keycodes) {
+        if (k.codePoint < table.size())
+            table[k.codePoint] = k.keycode;
+    }
+    return table;
+}();
+
+// Perfect hash (code point modulo size) for the few non-ASCII symbols
+constexpr auto ExtraKeycodes = [] {
+    std::array<Keycode, 17> table{};
+    for (auto const &k: Keycodes) {
+        if (k.codePoint >= AsciiKeycodes.size())
+            table[k.codePoint % table.size()] = k;
+    }
+    return table;
+}();
+
+constexpr bool hasAllKeycodes()
+{
+    for (auto const &k: Keycodes) {
+        if (k.codePoint < AsciiKeycodes.size()
+            ? AsciiKeycodes[k.codePoint].data() != k.keycode.data()
+            : ExtraKeycodes[k.codePoint % ExtraKeycodes.size()].codePoint != k.codePoint)
+            return false;
+    }
+    return true;
+}
+static_assert(hasAllKeycodes(), "Keycode tables have colliding entries");
+
+// Decodes the code point at pos and moves pos past it
+char32_t nextCodePoint(QStringView str, qsizetype &pos)
+{
+    auto const c = str[pos++];
+    if (c.isHighSurrogate() && pos < str.size() && str[pos].isLowSurrogate())
+        return QChar::surrogateToUcs4(c, str[pos++]);
+
+    return c.unicode();
+}
+
+constexpr QLatin1StringView LayerCodes[] = {
+    QLatin1StringView{""},
+    QLatin1StringView{"mos"},
+    QLatin1StringView{"nav"},
+    QLatin1StringView{"med"},
+    QLatin1StringView{"fun"},
+    QLatin1StringView{"num"},
+    QLatin1StringView{"sym"}
+};
+
+constexpr QLatin1StringView LayerNames[] = {
+    QLatin1StringView{"Base"},
+    QLatin1StringView{"Mouse"},
+    QLatin1StringView{"Navigation"},
+    QLatin1StringView{"Media"},
+    QLatin1StringView{"Function"},
+    QLatin1StringView{"Number"},
+    QLatin1StringView{"Symbol"}
+};
+
+constexpr QLatin1StringView MorphCodes[] = {
+    QLatin1StringView{"ne"},
+    QLatin1StringView{"e"},
+    QLatin1StringView{"se"},
+    QLatin1StringView{"nw"},
+    QLatin1StringView{"w"},
+    QLatin1StringView{"sw"}
+};
+
+constexpr QLatin1StringView ModCodes[] = {
+    QLatin1StringView{"CTL"},
+    QLatin1StringView{"ALT"},
+    QLatin1StringView{"GUI"}
+};
+
+// Order in which mod-morph chains are written, the base layer's first
+constexpr LayerType ModMorphLayers[] = {
+    LayerType::Base,
+    LayerType::Mouse,
+    LayerType::Navigation,
+    LayerType::Media,
+    LayerType::Symbol,
+    LayerType::Number,
+    LayerType::Function
+};
+
+constexpr QLatin1StringView None{"none"};
+constexpr QLatin1StringView Indent{"        "};
+constexpr QLatin1StringView PropertyIndent{"            "};
+
+bool isEastern(MorphType morphType)
+{
+    return morphType <= MorphType::SouthEast;
+}
+
+// A macro typed after its own antecedent skips the first letter instead of
+// erasing the antecedent with a backspace
+bool mergesFirstLetter(QStringView symbol, QStringView value)
+{
+    return !value.isEmpty() && symbol.compare(value.first(1), Qt::CaseInsensitive) == 0;
+}
+
+// Rough flash cost of a macro node on a 32-bit target: its device, config
+// and state, plus one behavior binding per control and key tap
+constexpr int MacroNodeBytes = 48;
+constexpr int MacroBindingBytes = 12;
+
+int macroFlashSize(QStringView value, Modifier modToIgnore)
+{
+    qsizetype bindings{1};
+    for (qsizetype i = 0; i < value.size(); ++bindings)
+        nextCodePoint(value, i);
+    if (modToIgnore != NoModifier)
+        bindings += 2;
+    return MacroNodeBytes + int(bindings) * MacroBindingBytes;
+}
+
+// Saved by moving a suffix of depth keys out of callers macros into a macro
+// of its own, which each of them then taps once
+int suffixSaving(int depth, int callers)
+{
+    return ((callers - 1) * depth - 1 - callers) * MacroBindingBytes - MacroNodeBytes;
+}
+
+constexpr QLatin1StringView MacroTemplate{R"TMPL(am%1_%2: am%1_%2 {
+            compatible = "zmk,behavior-macro";
+            #binding-cells = <0>;
+            wait-ms = <U_ANTMORPH_MACRO_WAIT>;
+            tap-ms = <U_ANTMORPH_MACRO_TAP>;
+            // %3%4
+            bindings = %5;
+        };)TMPL"};
+
+// Left-hand layers hold the west morphs, see Layer::morphTypeAt()
+int firstMorphOf(LayerType layerType)
+{
+    return int(layerType >= LayerType::Function ? MorphType::NorthWest : MorphType::NorthEast);
+}
+
+}
 
 ZmkCodeGenerator::ZmkCodeGenerator(Schema *schema)
-    : CodeGenerator{schema, CodeGenerator::ZMKFirmware}
+    : CodeGenerator{schema, CodeGenerator::ZMKFirmware},
+      m_optimizations{DefaultOptimizations},
+      m_minSuffixLength{DefaultMinSuffixLength}
 {
 
 }
 
+ZmkCodeGenerator::ZmkCodeGenerator(const SchemaSnapshot &snapshot)
+    : CodeGenerator{snapshot, CodeGenerator::ZMKFirmware},
+      m_optimizations{DefaultOptimizations},
+      m_minSuffixLength{DefaultMinSuffixLength}
+{
+
+}
+
+void ZmkCodeGenerator::setOptimizations(int optimizations)
+{
+    m_optimizations = optimizations;
+}
+
+int ZmkCodeGenerator::optimizations() const
+{
+    return m_optimizations;
+}
+
+void ZmkCodeGenerator::setMinSuffixLength(int keys)
+{
+    m_minSuffixLength = keys;
+}
+
+int ZmkCodeGenerator::minSuffixLength() const
+{
+    return m_minSuffixLength;
+}
+
 std::pair<bool, QString> ZmkCodeGenerator::verify()
 {
     for (auto const &a: m_schema->m_antecedents) {
-        for (auto const &l: a->m_layers) {
-            for (auto const &m: l->m_morphs) {
-                if (!m->isEmpty() && !m->isValid())
+        for (auto const &l: a.layers()) {
+            for (auto const &m: l.morphs()) {
+                if (!m.isEmpty() && !m.isValid())
                     return {false, QString{"[%1.%2.%3] Invalid value: '%4'"}
-                        .arg(a->name())
-                        .arg(l->name())
-                        .arg(m->name())
-                        .arg(m->value())};
-                for (auto i = m->m_value.cbegin(); i != m->m_value.cend(); i++) {
-                    if (zmkKeycode(*i).isNull())
+                        .arg(a.name())
+                        .arg(l.name())
+                        .arg(m.name())
+                        .arg(m.value())};
+                for (qsizetype i = 0; i < m.m_value.size();) {
+                    auto const codePoint = nextCodePoint(m.m_value, i);
+                    if (zmkKeycode(codePoint).isNull())
                         return {false, QString{"[%1.%2.%3] Invalid symbol: %4"}
-                            .arg(a->name())
-                            .arg(l->name())
-                            .arg(m->name())
-                            .arg(*i)};
+                            .arg(a.name())
+                            .arg(l.name())
+                            .arg(m.name())
+                            .arg(QString::fromUcs4(&codePoint, 1))};
                 }
-                for (auto const &md: m->m_mods) {
-                    if (!md->isEmpty() && !md->isValid())
+                for (auto const &md: m.m_mods) {
+                    if (!md.isEmpty() && !md.isValid())
                         return {false, QString{"[%1.%2.%3.%4] Invalid value: '%5'"}
-                            .arg(a->name())
-                            .arg(l->name())
-                            .arg(m->name())
-                            .arg(md->name())
-                            .arg(md->value())};
-                    for (auto i = md->m_value.cbegin(); i != md->m_value.cend(); i++) {
-                        if (zmkKeycode(*i).isNull())
+                            .arg(a.name())
+                            .arg(l.name())
+                            .arg(m.name())
+                            .arg(md.name())
+                            .arg(md.value())};
+                    for (qsizetype i = 0; i < md.m_value.size();) {
+                        auto const codePoint = nextCodePoint(md.m_value, i);
+                        if (zmkKeycode(codePoint).isNull())
                             return {false, QString{"[%1.%2.%3.%4] Invalid symbol: %5"}
-                                .arg(a->name())
-                                .arg(l->name())
-                                .arg(m->name())
-                                .arg(md->name())
-                                .arg(*i)};
+                                .arg(a.name())
+                                .arg(l.name())
+                                .arg(m.name())
+                                .arg(md.name())
+                                .arg(QString::fromUcs4(&codePoint, 1))};
                     }
                 }
             }
@@ -54,42 +354,167 @@ std::pair<bool, QString> ZmkCodeGenerator::prepare()
 {
     m_orderedMacros.clear();
     m_macros.clear();
+    m_suffixMacros.clear();
+    m_behaviors.fill({});
 
     QHash<QString,bool> usedMacroLabels;
+    QHash<QString,MacroParams*> sharedMacros;
+    int sharedCount{0};
+    int bytesSaved{0};
+    auto const addMacro = [&](QStringView symbol, SchemaItem *item) {
+        auto const value = macroValue(item);
+        auto const modToIgnore = item->pressedModifier();
+        QString key;
+        if (m_optimizations & DeduplicateMacros) {
+            key = QString{"%1\x1f%2\x1f%3"}
+                    .arg(mergesFirstLetter(symbol, value) ? '1' : '0')
+                    .arg(int(modToIgnore))
+                    .arg(value);
+            if (auto const shared = sharedMacros.value(key)) {
+                m_macros[item] = std::make_unique<MacroParams>(shared->label, shared->symbol, item);
+                ++sharedCount;
+                bytesSaved += macroFlashSize(value, modToIgnore);
+                return;
+            }
+        }
+
+        QString macroLabel = buildMacroLabel(value, usedMacroLabels);
+        usedMacroLabels[macroLabel] = true;
+        auto macroParams = std::make_unique<MacroParams>(macroLabel, symbol, item);
+        m_orderedMacros.push_back(macroParams.get());
+        if (!key.isNull())
+            sharedMacros.insert(key, macroParams.get());
+        m_macros[item] = std::move(macroParams);
+    };
 
     for (auto const &a: m_schema->m_antecedents) {
-        for (auto const &l: a->m_layers) {
-            for (auto const &m: l->m_morphs) {
-                if (!m->isEmpty() && !m->isSingleLettered(a->symbol()) && static_cast<Mode>(m->mode()) != Mode::MacroName) {
-                    QString macroLabel = buildMacroLabel(
-                                (m->mode() == int(Mode::SchemaName) ? m_schema->fullName() : m->value()),
-                                usedMacroLabels);
-                    usedMacroLabels[macroLabel] = true;
-                    auto macroParams = std::make_unique<MacroParams>(macroLabel, a->symbol(), m.get());
-                    m_orderedMacros.push_back(macroParams.get());
-                    m_macros[m.get()] = std::move(macroParams);
-                }
-                for (auto const &md: m->m_mods) {
-                    if (!md->isEmpty() && !md->isSingleLettered(a->symbol()) && static_cast<Mode>(m->mode()) != Mode::MacroName) {
-                        QString macroLabel = buildMacroLabel(
-                                    (md->mode() == int(Mode::SchemaName) ? m_schema->fullName() : md->value()),
-                                    usedMacroLabels);
-                        usedMacroLabels[macroLabel] = true;
-                        auto macroParams = std::make_unique<MacroParams>(macroLabel, a->symbol(), md.get());
-                        m_orderedMacros.push_back(macroParams.get());
-                        m_macros[md.get()] = std::move(macroParams);
-                    }
+        for (auto const &l: a.layers()) {
+            for (auto &m: l.morphs()) {
+                if (!m.isEmpty() && !m.isSingleLettered(a.symbol()) && static_cast<Mode>(m.mode()) != Mode::MacroName)
+                    addMacro(a.symbol(), &m);
+                if (!m.isEmpty())
+                    addBinding(l.m_type, m.m_type, -1, a, &m, m.isSingleLettered(a.symbol()));
+                for (auto &md: m.m_mods) {
+                    if (!md.isEmpty() && !md.isSingleLettered(a.symbol()) && static_cast<Mode>(m.mode()) != Mode::MacroName)
+                        addMacro(a.symbol(), &md);
+                    if (!md.isEmpty())
+                        addBinding(l.m_type, m.m_type, static_cast<int>(md.m_type), a, &md, md.isSingleLettered(a.symbol()));
                 }
             }
         }
     }
 
-    return {true, {}};
+    QStringList notes;
+    if (sharedCount)
+        notes << QString{"%1 repeated macros shared, about %2 bytes of flash saved"}.arg(sharedCount).arg(bytesSaved);
+    if (m_optimizations & FactorSuffixes) {
+        auto const note = factorSuffixes(usedMacroLabels);
+        if (!note.isEmpty())
+            notes << note;
+    }
+    return {true, notes.join("; ")};
+}
+
+QString ZmkCodeGenerator::factorSuffixes(QHash<QString, bool> &usedLabels)
+{
+    // Every macro's keys are inserted back to front, so macros ending alike
+    // share a path from the root; a node's callers are the macros that type
+    // more than the suffix it spells
+    struct TrieNode {
+        int depth;
+        std::vector<std::pair<char32_t, int>> children;
+        std::vector<int> callers;
+    };
+    struct Tail {
+        QString value;
+        std::vector<qsizetype> offsets;
+    };
+
+    std::vector<TrieNode> trie{{0, {}, {}}};
+    std::vector<Tail> tails(m_orderedMacros.size());
+    for (int i = 0; i < int(m_orderedMacros.size()); ++i) {
+        auto const *m = m_orderedMacros[i];
+        auto &tail = tails[i];
+        tail.value = macroValue(m->item);
+        if (mergesFirstLetter(m->symbol, tail.value))
+            tail.value = tail.value.sliced(1);
+
+        std::vector<char32_t> codePoints;
+        for (qsizetype pos = 0; pos < tail.value.size();) {
+            tail.offsets.push_back(pos);
+            codePoints.push_back(nextCodePoint(tail.value, pos));
+        }
+
+        int node{0};
+        for (auto k = codePoints.size(); k > 1; --k) {
+            auto const codePoint = codePoints[k - 1];
+            auto const &children = trie[node].children;
+            auto const child = std::find_if(children.cbegin(), children.cend(),
+                                            [codePoint](auto const &c) { return c.first == codePoint; });
+            int next;
+            if (child != children.cend()) {
+                next = child->second;
+            } else {
+                next = int(trie.size());
+                auto const depth = trie[node].depth + 1;
+                trie[node].children.emplace_back(codePoint, next);
+                trie.push_back({depth, {}, {}});
+            }
+            trie[next].callers.push_back(i);
+            node = next;
+        }
+    }
+
+    std::vector<int> candidates;
+    for (int n = 1; n < int(trie.size()); ++n) {
+        if (trie[n].depth >= m_minSuffixLength && suffixSaving(trie[n].depth, int(trie[n].callers.size())) > 0)
+            candidates.push_back(n);
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [&trie](int a, int b) {
+        return suffixSaving(trie[a].depth, int(trie[a].callers.size()))
+                > suffixSaving(trie[b].depth, int(trie[b].callers.size()));
+    });
+
+    // Callers already chained into a longer or more profitable suffix drop
+    // out of the shorter ones
+    int factoredCount{0};
+    int bytesSaved{0};
+    for (auto n: candidates) {
+        std::vector<int> callers;
+        for (auto i: trie[n].callers) {
+            if (m_orderedMacros[i]->suffix < 0)
+                callers.push_back(i);
+        }
+        auto const saved = suffixSaving(trie[n].depth, int(callers.size()));
+        if (saved <= 0)
+            continue;
+
+        auto const &tail = tails[callers.front()];
+        auto const value = tail.value.sliced(tail.offsets[tail.offsets.size() - trie[n].depth]);
+        auto const label = buildMacroLabel("sfx " + value, usedLabels);
+        usedLabels[label] = true;
+        for (auto i: callers)
+            m_orderedMacros[i]->suffix = int(m_suffixMacros.size());
+        m_suffixMacros.push_back({label, value});
+        factoredCount += int(callers.size());
+        bytesSaved += saved;
+    }
+
+    if (m_suffixMacros.empty())
+        return {};
+    return QString{"%1 suffixes factored out of %2 macros, about %3 bytes of flash saved"}
+            .arg(m_suffixMacros.size()).arg(factoredCount).arg(bytesSaved);
+}
+
+QString ZmkCodeGenerator::macroValue(const SchemaItem *item) const
+{
+    return (item->mode() == int(Mode::SchemaName) ? m_schema->fullName() : item->value());
 }
 
 void ZmkCodeGenerator::generate(QTextStream &out)
 {
     generateCommentary(out);
+    generateAliases(out);
     out << "/ {\n";
     out << QString{}.fill(' ', 4) << "behaviors {\n";
     generateModMorphs(out);
@@ -99,119 +524,13 @@ void ZmkCodeGenerator::generate(QTextStream &out)
     out << "};\n";
 }
 
-QString ZmkCodeGenerator::zmkKeycode(const QString &c)
+QLatin1StringView ZmkCodeGenerator::zmkKeycode(char32_t codePoint)
 {
-    static QHash<QString,QString> map{
-        {"a",  "A"},
-        {"b",  "B"},
-        {"c",  "C"},
-        {"d",  "D"},
-        {"e",  "E"},
-        {"f",  "F"},
-        {"g",  "G"},
-        {"h",  "H"},
-        {"i",  "I"},
-        {"j",  "J"},
-        {"k",  "K"},
-        {"l",  "L"},
-        {"m",  "M"},
-        {"n",  "N"},
-        {"o",  "O"},
-        {"p",  "P"},
-        {"q",  "Q"},
-        {"r",  "R"},
-        {"s",  "S"},
-        {"t",  "T"},
-        {"u",  "U"},
-        {"v",  "V"},
-        {"w",  "W"},
-        {"x",  "X"},
-        {"y",  "Y"},
-        {"z",  "Z"},
-
-        {"A",  "LS(A)"},
-        {"B",  "LS(B)"},
-        {"C",  "LS(C)"},
-        {"D",  "LS(D)"},
-        {"E",  "LS(E)"},
-        {"F",  "LS(F)"},
-        {"G",  "LS(G)"},
-        {"H",  "LS(H)"},
-        {"I",  "LS(I)"},
-        {"J",  "LS(J)"},
-        {"K",  "LS(K)"},
-        {"L",  "LS(L)"},
-        {"M",  "LS(M)"},
-        {"N",  "LS(N)"},
-        {"O",  "LS(O)"},
-        {"P",  "LS(P)"},
-        {"Q",  "LS(Q)"},
-        {"R",  "LS(R)"},
-        {"S",  "LS(S)"},
-        {"T",  "LS(T)"},
-        {"U",  "LS(U)"},
-        {"V",  "LS(V)"},
-        {"W",  "LS(W)"},
-        {"X",  "LS(X)"},
-        {"Y",  "LS(Y)"},
-        {"Z",  "LS(Z)"},
-
-        {"0",  "N0"},
-        {"1",  "N1"},
-        {"2",  "N2"},
-        {"3",  "N3"},
-        {"4",  "N4"},
-        {"5",  "N5"},
-        {"6",  "N6"},
-        {"7",  "N7"},
-        {"8",  "N8"},
-        {"9",  "N9"},
-
-        {" ",  "SPACE"},
-        {"!",  "EXCL"},
-        {"@",  "AT"},
-        {"#",  "HASH"},
-        {"$",  "DLLR"},
-        {"%",  "PRCNT"},
-        {"^",  "CARET"},
-        {"&",  "AMPS"},
-        {"*",  "STAR"},
-        {"(",  "LPAR"},
-        {")",  "RPAR"},
-        {"=",  "EQUAL"},
-        {"+",  "PLUS"},
-        {"-",  "MINUS"},
-        {"_",  "UNDER"},
-        {"/",  "FSLH"},
-        {"?",  "QMARK"},
-        {"\\", "BSLH"},
-        {"|",  "PIPE"},
-        {";", "SEMI"},
-        {":",  "COLON"},
-        {"'",  "APOS"},
-        {"‘",  "APOS"},
-        {"’",  "APOS"},
-        {"\"", "DQT"},
-        {"“",  "DQT"},
-        {"”",  "DQT"},
-        {",",  "COMMA"},
-        {".",  "DOT"},
-        {">",  "GT"},
-        {"<",  "LT"},
-        {"[",  "LBKT"},
-        {"]",  "RBKT"},
-        {"{",  "LBRC"},
-        {"}",  "RBRC"},
-        {"`",  "GRAVE"},
-        {"~",  "TILDE"},
-
-        {"←",  "LEFT"},
-        {"⏎", "RET"},
-
-        {"é",  "E"}
-    };
+    if (codePoint < AsciiKeycodes.size())
+        return AsciiKeycodes[codePoint];
 
-    return map.value(c, QString{});
+    auto const &extra = ExtraKeycodes[codePoint % ExtraKeycodes.size()];
+    return extra.codePoint == codePoint ? extra.keycode : QLatin1StringView{};
 }
 
 void ZmkCodeGenerator::generateCommentary(QTextStream &out)
@@ -220,152 +539,196 @@ void ZmkCodeGenerator::generateCommentary(QTextStream &out)
     out << "// Automatically generated by Antecedent Morph Configurator\n\n";
 }
 
-void ZmkCodeGenerator::generateModMorphs(QTextStream &out)
+std::pair<ZmkCodeGenerator::Node, ZmkCodeGenerator::Node> ZmkCodeGenerator::branches(Node node)
+{
+    switch (node) {
+        case Node::AltGUIMorph:
+            return {Node::Alt, Node::GUI};
+        case Node::ControlAltGUIMorph:
+            return {Node::Control, Node::AltGUIMorph};
+        case Node::ModMorph:
+            return {Node::Morph, Node::ControlAltGUIMorph};
+        default:
+            break;
+    }
+
+    assert(false && "Should not happen");
+    return {};
+}
+
+QString ZmkCodeGenerator::nodeLabel(LayerType layerType, MorphType morphType, Node node) const
 {
-    out << QString{}.fill(' ', 8) << "// Mod-Morphs\n";
-    generateBaseModMorphs(out);
-    if (m_schema->type() == Schema::Deep)
-        generateDeepModMorphs(out);
+    static constexpr char const *postfixes[] = {"", "c", "a", "g", "agm", "cagm", "m"};
+    QString label = "am" + m_schema->prefix();
+    label += LayerCodes[int(layerType)];
+    label += MorphCodes[int(morphType)];
+    label += QLatin1StringView{postfixes[int(node)]};
+    return label;
 }
 
-void ZmkCodeGenerator::generateBehaviors(QTextStream &out)
+bool ZmkCodeGenerator::isDead(LayerType layerType, MorphType morphType, Node node) const
 {
-    out << QString{}.fill(' ', 8) << "// Antecedent Morphs\n";
-    generateBaseBehaviors(out);
-    if (m_schema->type() == Schema::Deep)
-        generateDeepBehaviors(out);
+    if (node <= Node::GUI) {
+        auto const modType = int(node) - int(Node::Control);
+        return m_behaviors[Schema::bucket(layerType, morphType, modType)].bindings.isEmpty();
+    }
+
+    auto const [unmorphed, morphed] = branches(node);
+    return isDead(layerType, morphType, unmorphed) && isDead(layerType, morphType, morphed);
 }
 
-void ZmkCodeGenerator::generateBaseBehaviors(QTextStream &out)
+QString ZmkCodeGenerator::resolve(LayerType layerType, MorphType morphType, Node node) const
 {
-    for (int morphType = int(MorphType::NorthEast); morphType <= int(MorphType::SouthWest); ++morphType) {
-        QStringList bindings{};
-        QStringList antecedents{};
-        for (auto const &a: m_schema->m_antecedents) {
-            auto *morph = a->getMorph(LayerType::Base, static_cast<MorphType>(morphType));
-            if (morph->isEmpty())
-                continue;
-
-            auto const macroParams = m_macros.find(morph);
-            bindings << (static_cast<Mode>(morph->mode()) == Mode::MacroName
-                        ? QString{"<&amstdm_%1>"}.arg(morph->value())
-                        : buildBinding(morph->isSingleLettered(a->symbol()),
-                                       (macroParams != m_macros.cend() ? macroParams->second->label : QString{}),
-                                       morph->value()));
-            antecedents << a->zmkCode();
-        }
-        out << buildBehavior(LayerType::Base, static_cast<MorphType>(morphType),
-                             bindings.join(", "), antecedents.join(" "));
-        for (int modType = int(ModType::Control); modType <= int(ModType::GUI); ++modType) {
-            QStringList bindings{};
-            QStringList antecedents{};
-            for (auto const &a: m_schema->m_antecedents) {
-                auto *mod = a->getMod(LayerType::Base, static_cast<MorphType>(morphType), static_cast<ModType>(modType));
-                if (mod->isEmpty())
-                    continue;
-
-                auto const macroParams = m_macros.find(mod);
-                bindings << (static_cast<Mode>(mod->mode()) == Mode::MacroName
-                             ? QString{"<&amstdm_%1>"}.arg(mod->value())
-                             : buildBinding(mod->isSingleLettered(a->symbol()),
-                                         (macroParams != m_macros.cend() ? macroParams->second->label : QString{}),
-                                         mod->value()));
-                antecedents << a->zmkCode();
-            }
-            out << buildBehavior(LayerType::Base, static_cast<MorphType>(morphType), static_cast<ModType>(modType),
-                                 bindings.join(", "), antecedents.join(" "));
-        }
+    if ((m_optimizations & PruneDeadBehaviors) && isDead(layerType, morphType, node))
+        return QString{None};
+    if (node <= Node::GUI)
+        return nodeLabel(layerType, morphType, node);
+
+    if (!modsOf(layerType, morphType, node)) {
+        // Only one branch can still be taken
+        auto const [unmorphed, morphed] = branches(node);
+        auto const taken = (node == Node::ModMorph || isDead(layerType, morphType, morphed) ? unmorphed : morphed);
+        return resolve(layerType, morphType, taken);
     }
+    return nodeLabel(layerType, morphType, node);
 }
 
-void ZmkCodeGenerator::generateDeepBehaviors(QTextStream &out)
+int ZmkCodeGenerator::modsOf(LayerType layerType, MorphType morphType, Node node) const
 {
-    for (int layerType = int(LayerType::Mouse); layerType <= int(LayerType::Media); ++layerType) {
-        for (int morphType = int(MorphType::NorthEast); morphType <= int(MorphType::SouthEast); ++morphType) {
-            QStringList bindings{};
-            QStringList antecedents{};
-            for (auto const &a: m_schema->m_antecedents) {
-                auto *morph = a->getMorph(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType));
-                if (morph->isEmpty())
-                    continue;
-
-                auto const macroParams = m_macros.find(morph);
-                bindings << (static_cast<Mode>(morph->mode()) == Mode::MacroName
-                            ? QString{"<&amstdm_%1>"}.arg(morph->value())
-                            : buildBinding(morph->isSingleLettered(a->symbol()),
-                                           (macroParams != m_macros.cend() ? macroParams->second->label : QString{}),
-                                           morph->value()));
-                antecedents << a->zmkCode();
-            }
-            out << buildBehavior(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType),
-                                 bindings.join(", "), antecedents.join(" "));
-            for (int modType = int(ModType::Control); modType <= int(ModType::GUI); ++modType) {
-                QStringList bindings{};
-                QStringList antecedents{};
-                for (auto const &a: m_schema->m_antecedents) {
-                    auto *mod = a->getMod(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType), static_cast<ModType>(modType));
-                    if (mod->isEmpty())
-                        continue;
-
-                    auto const macroParams = m_macros.find(mod);
-                    bindings << (static_cast<Mode>(mod->mode()) == Mode::MacroName
-                                 ? QString{"<&amstdm_%1>"}.arg(mod->value())
-                                 : buildBinding(mod->isSingleLettered(a->symbol()),
-                                             (macroParams != m_macros.cend() ? macroParams->second->label : QString{}),
-                                             mod->value()));
-                    antecedents << a->zmkCode();
-                }
-                out << buildBehavior(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType), static_cast<ModType>(modType),
-                                     bindings.join(", "), antecedents.join(" "));
-            }
+    constexpr int control = 1 << int(ModType::Control);
+    constexpr int alt = 1 << int(ModType::Alt);
+    constexpr int gui = 1 << int(ModType::GUI);
+
+    if (!(m_optimizations & CollapseModMorphs)) {
+        switch (node) {
+            case Node::AltGUIMorph: return gui;
+            case Node::ControlAltGUIMorph: return alt | gui;
+            case Node::ModMorph: return control | alt | gui;
+            default: return 0;
         }
     }
-    for (int layerType = int(LayerType::Function); layerType <= int(LayerType::Symbol); ++layerType) {
-        for (int morphType = int(MorphType::NorthWest); morphType <= int(MorphType::SouthWest); ++morphType) {
-            QStringList bindings{};
-            QStringList antecedents{};
-            for (auto const &a: m_schema->m_antecedents) {
-                auto *morph = a->getMorph(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType));
-                if (morph->isEmpty())
-                    continue;
-
-                auto const macroParams = m_macros.find(morph);
-                bindings << (static_cast<Mode>(morph->mode()) == Mode::MacroName
-                            ? QString{"<&amstdm_%1>"}.arg(morph->value())
-                            : buildBinding(morph->isSingleLettered(a->symbol()),
-                                           (macroParams != m_macros.cend() ? macroParams->second->label : QString{}),
-                                           morph->value()));
-                antecedents << a->zmkCode();
-            }
-            out << buildBehavior(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType),
-                                 bindings.join(", "), antecedents.join(" "));
-            for (int modType = int(ModType::Control); modType <= int(ModType::GUI); ++modType) {
-                QStringList bindings{};
-                QStringList antecedents{};
-                for (auto const &a: m_schema->m_antecedents) {
-                    auto *mod = a->getMod(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType), static_cast<ModType>(modType));
-                    if (mod->isEmpty())
-                        continue;
-
-                    auto const macroParams = m_macros.find(mod);
-                    bindings << (static_cast<Mode>(mod->mode()) == Mode::MacroName
-                                 ? QString{"<&amstdm_%1>"}.arg(mod->value())
-                                 : buildBinding(mod->isSingleLettered(a->symbol()),
-                                             (macroParams != m_macros.cend() ? macroParams->second->label : QString{}),
-                                             mod->value()));
-                    antecedents << a->zmkCode();
-                }
-                out << buildBehavior(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType), static_cast<ModType>(modType),
-                                     bindings.join(", "), antecedents.join(" "));
-            }
+
+    int populated{0};
+    for (auto mod: {Node::Control, Node::Alt, Node::GUI}) {
+        if (!isDead(layerType, morphType, mod))
+            populated |= 1 << (int(mod) - int(Node::Control));
+    }
+    switch (node) {
+        case Node::AltGUIMorph:
+            return (populated & alt) && (populated & gui) ? gui : 0;
+        case Node::ControlAltGUIMorph:
+            return (populated & control) ? populated & (alt | gui) : 0;
+        case Node::ModMorph:
+            return populated;
+        default:
+            return 0;
+    }
+}
+
+template <typename F>
+void ZmkCodeGenerator::forEachDirection(F f) const
+{
+    auto const layerCount = (m_schema->type() == Schema::Deep ? Antecedent::LayerCount : 1);
+    for (int layerType = int(LayerType::Base); layerType < layerCount; ++layerType) {
+        auto const first = firstMorphOf(static_cast<LayerType>(layerType));
+        auto const count = Layer::morphCount(static_cast<LayerType>(layerType));
+        for (int morphType = first; morphType < first + count; ++morphType)
+            f(static_cast<LayerType>(layerType), static_cast<MorphType>(morphType));
+    }
+}
+
+void ZmkCodeGenerator::generateAliases(QTextStream &out)
+{
+    if (!(m_optimizations & (PruneDeadBehaviors | CollapseModMorphs)))
+        return;
+
+    // Keymaps may still refer to the nodes left out, so their labels are
+    // defined to whatever they resolved to
+    QString aliases;
+    forEachDirection([&](LayerType layerType, MorphType morphType) {
+        for (int node = int(Node::Morph); node <= int(Node::ModMorph); ++node) {
+            auto const label = nodeLabel(layerType, morphType, static_cast<Node>(node));
+            auto const target = resolve(layerType, morphType, static_cast<Node>(node));
+            if (target != label)
+                aliases += QString{"#define %1 %2\n"}.arg(label, target);
         }
+    });
+    if (!aliases.isEmpty())
+        out << "// Behaviors left out of this file\n" << aliases << "\n";
+}
+
+void ZmkCodeGenerator::generateModMorphs(QTextStream &out)
+{
+    out << Indent << "// Mod-Morphs\n";
+    for (auto layerType: ModMorphLayers) {
+        if (layerType != LayerType::Base && m_schema->type() != Schema::Deep)
+            break;
+        generateLayerModMorphs(out, layerType);
+    }
+}
+
+void ZmkCodeGenerator::generateLayerModMorphs(QTextStream &out, LayerType layerType)
+{
+    out << Indent << "// " << LayerNames[int(layerType)] << " layer\n";
+    auto const first = firstMorphOf(layerType);
+    for (int morphType = first; morphType < first + Layer::morphCount(layerType); ++morphType) {
+        out << Indent << "// " << MorphCodes[morphType].toString().toUpper() << "\n";
+        for (auto node: {Node::AltGUIMorph, Node::ControlAltGUIMorph, Node::ModMorph})
+            generateModMorph(out, layerType, static_cast<MorphType>(morphType), node);
+    }
+}
+
+void ZmkCodeGenerator::generateModMorph(QTextStream &out, LayerType layerType, MorphType morphType, Node node)
+{
+    auto const label = nodeLabel(layerType, morphType, node);
+    if (resolve(layerType, morphType, node) != label)
+        return;
+
+    auto const [unmorphed, morphed] = branches(node);
+    out << Indent << label << ": " << label << " {\n"
+        << PropertyIndent << "compatible = \"zmk,behavior-mod-morph\";\n"
+        << PropertyIndent << "#binding-cells = <0>;\n"
+        << PropertyIndent << "bindings = <&" << resolve(layerType, morphType, unmorphed)
+        << ">, <&" << resolve(layerType, morphType, morphed) << ">;\n"
+        << PropertyIndent << "mods = <(";
+
+    auto const mods = modsOf(layerType, morphType, node);
+    bool first{true};
+    for (int modType = int(ModType::Control); modType <= int(ModType::GUI); ++modType) {
+        if (!(mods & (1 << modType)))
+            continue;
+        out << (first ? "" : "|") << (isEastern(morphType) ? "MOD_L" : "MOD_R") << ModCodes[modType];
+        first = false;
+    }
+    out << ")>;\n" << Indent << "};\n";
+}
+
+void ZmkCodeGenerator::generateBehaviors(QTextStream &out)
+{
+    out << Indent << "// Antecedent Morphs\n";
+    forEachDirection([this, &out](LayerType layerType, MorphType morphType) {
+        generateMorphBehaviors(out, layerType, morphType);
+    });
+}
+
+void ZmkCodeGenerator::generateMorphBehaviors(QTextStream &out, LayerType layerType, MorphType morphType)
+{
+    bool const prune = m_optimizations & PruneDeadBehaviors;
+    for (int modType = -1; modType <= int(ModType::GUI); ++modType) {
+        auto const &behavior = m_behaviors[Schema::bucket(layerType, morphType, modType)];
+        if (prune && behavior.bindings.isEmpty())
+            continue;
+        out << (modType < 0
+                ? buildBehavior(layerType, morphType, behavior.bindings.join(", "), behavior.antecedents)
+                : buildBehavior(layerType, morphType, static_cast<ModType>(modType),
+                                behavior.bindings.join(", "), behavior.antecedents));
     }
 }
 
 void ZmkCodeGenerator::generateMacros(QTextStream &out)
 {
     out << QString{}.fill(' ', 4) << "macros {\n";
-    QString symbol{};
+    QStringView symbol{};
     for (auto *m: m_orderedMacros) {
         if (m->symbol != symbol) {
             symbol = m->symbol;
@@ -384,490 +747,36 @@ void ZmkCodeGenerator::generateMacros(QTextStream &out)
                 break;
         }
 
-        out << buildMacro(m->symbol, m->label, val, m->item->pressedModifier());
+        out << buildMacro(m->symbol, m->label, val, m->item->pressedModifier(),
+                          (m->suffix < 0 ? nullptr : &m_suffixMacros[m->suffix]));
     }
-    out << QString{}.fill(' ', 4) << "};\n";
-}
 
-void ZmkCodeGenerator::generateBaseModMorphs(QTextStream &out)
-{
-    static QString tmpl = R"TMPL(
-        // Base layer
-        // NE
-        am%1neagm: am%1neagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1nea>, <&am%1neg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1necagm: am%1necagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1nec>, <&am%1neagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1nem: am%1nem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1ne>, <&am%1necagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // E
-        am%1eagm: am%1eagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1ea>, <&am%1eg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1ecagm: am%1ecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1ec>, <&am%1eagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1em: am%1em {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1e>, <&am%1ecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // SE
-        am%1seagm: am%1seagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1sea>, <&am%1seg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1secagm: am%1secagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1sec>, <&am%1seagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1sem: am%1sem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1se>, <&am%1secagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // NW
-        am%1nwagm: am%1nwagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1nwa>, <&am%1nwg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1nwcagm: am%1nwcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1nwc>, <&am%1nwagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1nwm: am%1nwm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1nw>, <&am%1nwcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // W
-        am%1wagm: am%1wagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1wa>, <&am%1wg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1wcagm: am%1wcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1wc>, <&am%1wagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1wm: am%1wm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1w>, <&am%1wcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // SW
-        am%1swagm: am%1swagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1swa>, <&am%1swg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1swcagm: am%1swcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1swc>, <&am%1swagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1swm: am%1swm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1sw>, <&am%1swcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };)TMPL";
-    out << tmpl.sliced(1).arg(m_schema->prefix()) << "\n";
+    if (!m_suffixMacros.empty())
+        out << Indent << "// Shared suffixes\n";
+    for (auto const &suffix: m_suffixMacros)
+        out << buildSuffixMacro(suffix);
+    out << QString{}.fill(' ', 4) << "};\n";
 }
 
-void ZmkCodeGenerator::generateDeepModMorphs(QTextStream &out)
+void ZmkCodeGenerator::addBinding(LayerType layerType, MorphType morphType, int modType,
+                                  const Antecedent &antecedent, SchemaItem *item, bool isSingleLettered)
 {
-    static QString tmpl = R"TMPL(
-        // Mouse layer
-        // NE
-        am%1mosneagm: am%1mosneagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mosnea>, <&am%1mosneg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1mosnecagm: am%1mosnecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mosnec>, <&am%1mosneagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1mosnem: am%1mosnem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mosne>, <&am%1mosnecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // E
-        am%1moseagm: am%1moseagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mosea>, <&am%1moseg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1mosecagm: am%1mosecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mosec>, <&am%1moseagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1mosem: am%1mosem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mose>, <&am%1mosecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // SE
-        am%1mosseagm: am%1mosseagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mossea>, <&am%1mosseg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1mossecagm: am%1mossecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mossec>, <&am%1mosseagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1mossem: am%1mossem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mosse>, <&am%1mossecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // Navigation layer
-        // NE
-        am%1navneagm: am%1navneagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1navnea>, <&am%1navneg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1navnecagm: am%1navnecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1navnec>, <&am%1navneagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1navnem: am%1navnem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1navne>, <&am%1navnecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // E
-        am%1naveagm: am%1naveagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1navea>, <&am%1naveg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1navecagm: am%1navecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1navec>, <&am%1naveagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1navem: am%1navem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1nave>, <&am%1navecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // SE
-        am%1navseagm: am%1navseagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1navsea>, <&am%1navseg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1navsecagm: am%1navsecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1navsec>, <&am%1navseagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1navsem: am%1navsem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1navse>, <&am%1navsecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // Media layer
-        // NE
-        am%1medneagm: am%1medneagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mednea>, <&am%1medneg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1mednecagm: am%1mednecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mednec>, <&am%1medneagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1mednem: am%1mednem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1medne>, <&am%1mednecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // E
-        am%1medeagm: am%1medeagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1medea>, <&am%1medeg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1medecagm: am%1medecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1medec>, <&am%1medeagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1medem: am%1medem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1mede>, <&am%1medecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // SE
-        am%1medseagm: am%1medseagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1medsea>, <&am%1medseg>;
-            mods = <(MOD_LGUI)>;
-        };
-        am%1medsecagm: am%1medsecagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1medsec>, <&am%1medseagm>;
-            mods = <(MOD_LALT|MOD_LGUI)>;
-        };
-        am%1medsem: am%1medsem {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1medse>, <&am%1medsecagm>;
-            mods = <(MOD_LCTL|MOD_LALT|MOD_LGUI)>;
-        };
-        // Symbol layer
-        // NW
-        am%1symnwagm: am%1symnwagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symnwa>, <&am%1symnwg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1symnwcagm: am%1symnwcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symnwc>, <&am%1symnwagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1symnwm: am%1symnwm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symnw>, <&am%1symnwcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // W
-        am%1symwagm: am%1symwagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symwa>, <&am%1symwg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1symwcagm: am%1symwcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symwc>, <&am%1symwagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1symwm: am%1symwm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symw>, <&am%1symwcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // SW
-        am%1symswagm: am%1symswagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symswa>, <&am%1symswg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1symswcagm: am%1symswcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symswc>, <&am%1symswagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1symswm: am%1symswm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1symsw>, <&am%1symswcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // Number layer
-        // NW
-        am%1numnwagm: am%1numnwagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numnwa>, <&am%1numnwg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1numnwcagm: am%1numnwcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numnwc>, <&am%1numnwagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1numnwm: am%1numnwm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numnw>, <&am%1numnwcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // W
-        am%1numwagm: am%1numwagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numwa>, <&am%1numwg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1numwcagm: am%1numwcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numwc>, <&am%1numwagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1numwm: am%1numwm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numw>, <&am%1numwcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // SW
-        am%1numswagm: am%1numswagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numswa>, <&am%1numswg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1numswcagm: am%1numswcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numswc>, <&am%1numswagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1numswm: am%1numswm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1numsw>, <&am%1numswcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // Function layer
-        // NW
-        am%1funnwagm: am%1funnwagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funnwa>, <&am%1funnwg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1funnwcagm: am%1funnwcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funnwc>, <&am%1funnwagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1funnwm: am%1funnwm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funnw>, <&am%1funnwcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // W
-        am%1funwagm: am%1funwagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funwa>, <&am%1funwg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1funwcagm: am%1funwcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funwc>, <&am%1funwagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1funwm: am%1funwm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funw>, <&am%1funwcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };
-        // SW
-        am%1funswagm: am%1funswagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funswa>, <&am%1funswg>;
-            mods = <(MOD_RGUI)>;
-        };
-        am%1funswcagm: am%1funswcagm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funswc>, <&am%1funswagm>;
-            mods = <(MOD_RALT|MOD_RGUI)>;
-        };
-        am%1funswm: am%1funswm {
-            compatible = "zmk,behavior-mod-morph";
-            #binding-cells = <0>;
-            bindings = <&am%1funsw>, <&am%1funswcagm>;
-            mods = <(MOD_RCTL|MOD_RALT|MOD_RGUI)>;
-        };)TMPL";
-    out << tmpl.sliced(1).arg(m_schema->prefix()) << "\n";
+    auto const macroParams = m_macros.find(item);
+    auto &behavior = m_behaviors[Schema::bucket(layerType, morphType, modType)];
+    behavior.bindings << (static_cast<Mode>(item->mode()) == Mode::MacroName
+                          ? QString{"<&amstdm_%1>"}.arg(item->value())
+                          : buildBinding(isSingleLettered,
+                                         (macroParams != m_macros.cend() ? macroParams->second->label : QString{}),
+                                         item->value()));
+    if (!behavior.antecedents.isEmpty())
+        behavior.antecedents += ' ';
+    behavior.antecedents += antecedent.zmkCode();
 }
 
 QString ZmkCodeGenerator::buildBinding(bool isSingleLettered, const QString &macroLabel, const QString &value) const
 {
     if (isSingleLettered)
-        return QString{"<&kp %1>"}.arg(zmkKeycode(value.sliced(1,1)));
+        return QString{"<&kp %1>"}.arg(zmkKeycode(value.at(1).unicode()));
 
     return QString{"<&am%1_%2>"}.arg(m_schema->prefix(), macroLabel);
 }
@@ -897,26 +806,18 @@ QString ZmkCodeGenerator::buildMacroLabel(const QString &value, QHash<QString,bo
     return label + (postfix ? QString::number(postfix) : QString{});
 }
 
-QString ZmkCodeGenerator::buildMacro(const QString &symbol, const QString &label, const QString &value, Modifier modToIgnore) const
+QString ZmkCodeGenerator::buildMacro(QStringView symbol, const QString &label, const QString &value, Modifier modToIgnore,
+                                     SuffixMacro const *suffix) const
 {
-    static QString tmpl{R"TMPL(am%1_%2: am%1_%2 {
-            compatible = "zmk,behavior-macro";
-            #binding-cells = <0>;
-            wait-ms = <U_ANTMORPH_MACRO_WAIT>;
-            tap-ms = <U_ANTMORPH_MACRO_TAP>;
-            // %3%4
-            bindings = %5;
-        };)TMPL"};
-
-    QString out = tmpl;
+    QString out = MacroTemplate;
     QString pre, firstOp;
     QString val = value;
-    if (symbol.toLower() == val.first(1).toLower()) {
+    if (mergesFirstLetter(symbol, val)) {
         pre = QString("(") + val.first(1).toLower() + ")";
         firstOp = "";
         val = val.sliced(1);
     } else {
-        pre = QString("[") + symbol.toLower() + "]";
+        pre = QString("[") + symbol.toString().toLower() + "]";
         firstOp = "&kp BSPC ";
     }
 
@@ -972,12 +873,14 @@ QString ZmkCodeGenerator::buildMacro(const QString &symbol, const QString &label
         undoModActions = QString{"<&macro_tap &kp "} + undoModActions + ">";
 
     QString bindings;
-    for (auto const &l: val.split(QString())) {
-        if (l.isEmpty())
-            continue;
-
-        bindings += QString("&kp ") + zmkKeycode(l) + " ";
+    auto const typed = val.size() - (suffix ? suffix->value.size() : 0);
+    for (qsizetype i = 0; i < typed;) {
+        bindings += "&kp ";
+        bindings += zmkKeycode(nextCodePoint(val, i));
+        bindings += ' ';
     }
+    if (suffix)
+        bindings += QString{"&am%1_%2"}.arg(m_schema->prefix(), suffix->label);
     QString taps = QString{"<&macro_tap %1>"}.arg(firstOp + bindings.trimmed());
     QString sequence = (!releaseMods.isEmpty() ? releaseMods + ", " : "");
     if (!undoModActions.isEmpty())
@@ -988,6 +891,20 @@ QString ZmkCodeGenerator::buildMacro(const QString &symbol, const QString &label
     return out.arg(m_schema->prefix(), label, pre, val, sequence).prepend(QString{}.fill(' ', 8)).append("\n");
 }
 
+QString ZmkCodeGenerator::buildSuffixMacro(const SuffixMacro &suffix) const
+{
+    QString bindings;
+    for (qsizetype i = 0; i < suffix.value.size();) {
+        bindings += "&kp ";
+        bindings += zmkKeycode(nextCodePoint(suffix.value, i));
+        bindings += ' ';
+    }
+    return QString{MacroTemplate}
+            .arg(m_schema->prefix(), suffix.label, "...", suffix.value,
+                 QString{"<&macro_tap %1>"}.arg(bindings.trimmed()))
+            .prepend(Indent).append("\n");
+}
+
 QString ZmkCodeGenerator::buildBehavior(LayerType layerType, MorphType morphType, ModType modType,
                                         const QString &bindings, const QString &antecedents) const
 {
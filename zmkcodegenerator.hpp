@@ -4,33 +4,92 @@
 #include "codegenerator.hpp"
 #include "schema.hpp"
 #include <QString>
+#include <array>
 
 class ZmkCodeGenerator : public CodeGenerator
 {
+public:
+    enum Optimization {
+        NoOptimization = 0x0,
+        // Leaves out behaviors and mod-morph levels that can only resolve to
+        // &none; references to them are rewired and their labels #defined
+        PruneDeadBehaviors = 0x1,
+        // Mod-morphs test only for modifiers with cells of their own. A held
+        // modifier without any is treated as released, so with only Alt
+        // populated Ctrl+key types the plain morph instead of nothing.
+        // Levels left with nothing to test for are replaced by their one
+        // remaining branch
+        CollapseModMorphs = 0x2,
+        // Cells typing the same keys share one macro node; prepare() reports
+        // how many and the flash saved
+        DeduplicateMacros = 0x4,
+        // Endings shared by several macros move into macros of their own that
+        // the callers tap last, trading flash for one more behavior invocation
+        // per keypress; see setMinSuffixLength()
+        FactorSuffixes = 0x8,
+    };
+    static constexpr int DefaultOptimizations = PruneDeadBehaviors | CollapseModMorphs | DeduplicateMacros;
+    static constexpr int DefaultMinSuffixLength = 4;
+
 public:
     ZmkCodeGenerator(Schema *schema);
+    ZmkCodeGenerator(SchemaSnapshot const &snapshot);
     ~ZmkCodeGenerator() override = default;
 
     std::pair<bool, QString> verify() override;
     std::pair<bool, QString> prepare() override;
     void generate(QTextStream &out) override;
 
-    static QString zmkKeycode(QString const& c);
+    void setOptimizations(int optimizations);
+    int optimizations() const;
+    // Shortest ending, in keys, worth the extra invocation of FactorSuffixes
+    void setMinSuffixLength(int keys);
+    int minSuffixLength() const;
+
+    static QLatin1StringView zmkKeycode(char32_t codePoint);
+private:
+    // Nodes of one direction: its antecedent-morphs and the mod-morph chain
+    // selecting between them
+    enum class Node {
+        Morph,
+        Control,
+        Alt,
+        GUI,
+        AltGUIMorph,
+        ControlAltGUIMorph,
+        ModMorph
+    };
+
+    static std::pair<Node, Node> branches(Node node);
+    QString nodeLabel(LayerType layerType, MorphType morphType, Node node) const;
+    bool isDead(LayerType layerType, MorphType morphType, Node node) const;
+    int modsOf(LayerType layerType, MorphType morphType, Node node) const;
+    QString resolve(LayerType layerType, MorphType morphType, Node node) const;
+    template <typename F>
+    void forEachDirection(F f) const;
+
 private:
     void generateCommentary(QTextStream &out);
+    void generateAliases(QTextStream &out);
     void generateModMorphs(QTextStream &out);
     void generateBehaviors(QTextStream &out);
-    void generateBaseBehaviors(QTextStream &out);
-    void generateDeepBehaviors(QTextStream &out);
+    void generateMorphBehaviors(QTextStream &out, LayerType layerType, MorphType morphType);
     void generateMacros(QTextStream &out);
 
-    void generateBaseModMorphs(QTextStream &out);
-    void generateDeepModMorphs(QTextStream &out);
+    void generateLayerModMorphs(QTextStream &out, LayerType layerType);
+    void generateModMorph(QTextStream &out, LayerType layerType, MorphType morphType, Node node);
 
 private:
+    void addBinding(LayerType layerType, MorphType morphType, int modType,
+                    Antecedent const &antecedent, SchemaItem *item, bool isSingleLettered);
     QString buildBinding(bool isSingleLettered, QString const &macroLabel, const QString &value) const;
     QString buildMacroLabel(QString const &value, QHash<QString, bool> &usedLabels) const;
-    QString buildMacro(QString const &symbol, QString const &label, const QString &value, Modifier modToIgnore) const;
+    struct SuffixMacro;
+    QString buildMacro(QStringView symbol, QString const &label, const QString &value, Modifier modToIgnore,
+                       SuffixMacro const *suffix = nullptr) const;
+    QString buildSuffixMacro(SuffixMacro const &suffix) const;
+    QString factorSuffixes(QHash<QString, bool> &usedLabels);
+    QString macroValue(SchemaItem const *item) const;
     QString buildBehavior(LayerType layerType, MorphType morphType, ModType modType,
                           QString const &bindings, QString const &antecedents) const;
     QString buildBehavior(LayerType layerType, MorphType morphType,
@@ -39,16 +98,33 @@ private:
                           QString const &bindings, QString const &antecedents) const;
 
 private:
+    int m_optimizations;
+    int m_minSuffixLength;
+
     struct MacroParams {
-        MacroParams(QString const &label, QString const &symbol, SchemaItem *item)
+        MacroParams(QString const &label, QStringView symbol, SchemaItem *item)
             : label{label}, symbol{symbol}, item{item}
         { }
         QString label;
-        QString symbol;
+        QStringView symbol;
         SchemaItem *item;
+        int suffix{-1}; // index into m_suffixMacros
     };
     std::unordered_map<SchemaItem*, std::unique_ptr<MacroParams>> m_macros;
     std::vector<MacroParams*> m_orderedMacros;
+
+    struct SuffixMacro {
+        QString label;
+        QString value;
+    };
+    std::vector<SuffixMacro> m_suffixMacros;
+
+    // Bindings gathered per (layer, morph[, mod]) bucket while preparing
+    struct Behavior {
+        QStringList bindings;
+        QString antecedents;
+    };
+    std::array<Behavior, Schema::BucketCount> m_behaviors;
 };
 
 #endif // ZMKCODEGENERATOR_HPP